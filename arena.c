@@ -0,0 +1,34 @@
+/*
+ * Filename: arena.c
+ * Two-pass arena layout, see arena.h.
+ */
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+void *arena_alloc_aligned(struct arena *a, size_t size, size_t align) {
+  size_t at = (a->used + align - 1) & ~(align - 1);
+  a->used = at + size;
+  return a->base ? a->base + at : NULL;
+}
+
+void arena_map(struct arena *a) {
+  a->size = arena_page_round(a->used);
+  // Reserve only: pages are allocated, on the toucher's node, when used.
+  void *map = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED) {
+    perror("arena");
+    exit(EXIT_FAILURE);
+  }
+  a->base = (char *)map;
+  a->used = 0;
+}
+
+void arena_unmap(struct arena *a) {
+  munmap(a->base, a->size);
+  a->base = NULL;
+  a->size = a->used = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Filename: arena.h
+ * A single mapping holding the simulator's caches and statistics.
+ *
+ * State is laid out by code that carves it from an arena in a fixed order.
+ * That code runs twice: first on an empty arena, which only adds up the
+ * sizes, then on the mapped arena, where every carve returns memory. The
+ * whole layout is therefore one mmap and one munmap however many cores and
+ * cache levels there are.
+ *
+ * The mapping starts out zeroed and untouched. Linux places each page on the
+ * NUMA node of the thread that first touches it, so state that is laid out
+ * by the thread which later uses it lives on that thread's node.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Every carve starts on its own host cache line.
+#define ARENA_ALIGN 64
+#define ARENA_PAGE 4096
+
+struct arena {
+  char *base; // NULL while sizing
+  size_t size;
+  size_t used;
+};
+
+// Whether a only counts bytes. Layout code must not write through the NULL
+// pointers it gets while sizing.
+static inline bool arena_sizing(const struct arena *a) { return !a->base; }
+
+// size zeroed bytes, aligned to align (a power of two of at least
+// ARENA_ALIGN). NULL while sizing.
+void *arena_alloc_aligned(struct arena *a, size_t size, size_t align);
+
+static inline void *arena_alloc(struct arena *a, size_t size) {
+  return arena_alloc_aligned(a, size, ARENA_ALIGN);
+}
+
+// size rounded up to whole pages.
+static inline size_t arena_page_round(size_t size) {
+  return (size + ARENA_PAGE - 1) & ~(size_t)(ARENA_PAGE - 1);
+}
+
+// Map the bytes counted so far and start carving from the beginning again.
+// Exits if there is not enough memory.
+void arena_map(struct arena *a);
+
+void arena_unmap(struct arena *a);
+
+#endif
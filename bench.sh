@@ -0,0 +1,47 @@
+#!/bin/sh
+# Filename: bench.sh
+# Measures simulator throughput on synthetic traces of every gen_trace
+# pattern. Reports simulated accesses per second, in total and per host
+# thread: one per simulated core, or $WORKERS with the worker pool (-w).
+# $SIM_OPTS is passed to every run, by default a 64-set 8-way L1 with 64-byte
+# lines.
+#
+# usage: ./bench.sh [instructions_per_core] [cores] [patterns...]
+set -e
+
+insts=${1:-200000}
+cores=${2:-4}
+if [ $# -ge 2 ]; then shift 2; else shift $#; fi
+patterns=${*:-uniform zipf stream prodcons falseshare lock}
+opts=${SIM_OPTS:--S 64 -A 8 -B 64}
+hosts=$cores
+if [ -n "$WORKERS" ]; then
+  opts="$opts -w $WORKERS"
+  hosts=$((WORKERS < cores ? WORKERS : cores))
+fi
+
+make -s compile gen_trace >/dev/null
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+echo "$cores cores, $insts accesses per core, $hosts host threads: $opts"
+printf "%-12s %10s %14s %18s\n" pattern seconds "accesses/s" \
+  "per thread (op/s)"
+for p in $patterns; do
+  ./gen_trace -p "$p" -c "$cores" -n "$insts" "$dir/$p" >/dev/null
+  files=""
+  i=0
+  while [ "$i" -lt "$cores" ]; do
+    files="$files $dir/${p}_$i.trc"
+    i=$((i + 1))
+  done
+  start=$(date +%s.%N)
+  ./cache_sim -o quiet $opts $files >/dev/null
+  end=$(date +%s.%N)
+  awk -v p="$p" -v s="$start" -v e="$end" -v ops=$((cores * insts)) \
+    -v hosts="$hosts" 'BEGIN {
+      t = e - s;
+      printf "%-12s %10.3f %14.0f %18.0f\n", p, t, ops / t, ops / t / hosts
+    }'
+  rm -f "$dir/${p}"_*.trc
+done
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Filename: bench_scaling.sh
+# Measures simulator throughput against the number of simulated cores, once
+# with a single global coherence lock (-l 1, the old critical section) and
+# once with one lock per set (the default), and once with set locks on a pool
+# of $WORKERS host threads (-w, default one per host CPU) instead of one
+# thread per simulated core.
+#
+# usage: ./bench_scaling.sh [instructions_per_core] [core counts...]
+set -e
+
+insts=${1:-100000}
+shift 2>/dev/null || true
+cores=${*:-1 2 4 8 16}
+workers=${WORKERS:-$(nproc)}
+
+make -s compile >/dev/null
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# Random reads and writes over the 24-byte memory, one trace per core.
+max=0
+for n in $cores; do
+  [ "$n" -gt "$max" ] && max=$n
+done
+i=0
+while [ "$i" -lt "$max" ]; do
+  awk -v n="$insts" -v seed="$i" 'BEGIN {
+    srand(seed + 1);
+    for (k = 0; k < n; k++) {
+      a = int(rand() * 24);
+      if (rand() < 0.3) printf "WR %d %d\n", a, int(rand() * 100);
+      else printf "RD %d\n", a;
+    }
+  }' > "$dir/input_$i.txt"
+  ./trace_conv "$dir/input_$i.txt" "$dir/input_$i.trc" >/dev/null
+  i=$((i + 1))
+done
+
+printf "%6s %18s %18s %18s\n" cores "global lock (op/s)" "set locks (op/s)" \
+  "$workers workers (op/s)"
+for n in $cores; do
+  files=""
+  i=0
+  while [ "$i" -lt "$n" ]; do
+    files="$files $dir/input_$i.trc"
+    i=$((i + 1))
+  done
+  printf "%6d" "$n"
+  for opts in "-l 1" "-l 0" "-w $workers"; do
+    start=$(date +%s.%N)
+    ./cache_sim -q 0 $opts $files >/dev/null
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" -v ops=$((n * insts)) \
+      'BEGIN { printf " %18.0f", ops / (e - s) }'
+  done
+  echo
+done
@@ -0,0 +1,124 @@
+/*
+ * Filename: bench_tags.c
+ * Microbenchmark for cache set lookups. Compares the old array-of-structs
+ * line layout against the structure-of-arrays layout used by the simulator,
+ * searched with the scalar loop and with the vector kernels of tag_match.h.
+ *
+ * usage: bench_tags [lookups]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tag_match.h"
+
+// Total lines per layout, split into sets of the benchmarked associativity.
+#define LINES (1 << 16)
+
+// The line layout the simulator used before the switch to structure of arrays.
+struct aos_line {
+  uint64_t address;
+  int state; // mesi_state
+};
+
+static struct aos_line aos[LINES];
+static uint64_t tags[LINES];
+static uint8_t states[LINES + TAG_MATCH_PAD];
+
+struct query {
+  uint32_t base; // first line of the set
+  uint64_t tag;
+};
+
+static inline __attribute__((always_inline)) int
+aos_find(const struct aos_line *set, uint64_t tag, const int ways) {
+#pragma GCC unroll 16
+  for (int w = 0; w < ways; w++) {
+    if (set[w].state && set[w].address == tag)
+      return w;
+  }
+  return -1;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time n lookups with each kernel for a constant way count. Returns the
+// nanoseconds per lookup in ns[0..2] (AoS, SoA scalar, SoA vector).
+#define BENCH(ways)                                                            \
+  static void bench_##ways(const struct query *q, long n, double *ns) {       \
+    long sum[3] = {0};                                                         \
+    double t0 = now();                                                         \
+    for (long i = 0; i < n; i++)                                               \
+      sum[0] += aos_find(aos + q[i].base, q[i].tag, ways);                     \
+    double t1 = now();                                                         \
+    for (long i = 0; i < n; i++)                                               \
+      sum[1] += tag_find_scalar(tags + q[i].base, states + q[i].base,          \
+                                q[i].tag, ways);                               \
+    double t2 = now();                                                         \
+    for (long i = 0; i < n; i++)                                               \
+      sum[2] +=                                                                \
+          tag_find(tags + q[i].base, states + q[i].base, q[i].tag, ways);      \
+    double t3 = now();                                                         \
+    if (sum[0] != sum[1] || sum[1] != sum[2])                                  \
+      fprintf(stderr, "%d ways: kernels disagree\n", ways);                    \
+    ns[0] = (t1 - t0) * 1e9 / n;                                               \
+    ns[1] = (t2 - t1) * 1e9 / n;                                               \
+    ns[2] = (t3 - t2) * 1e9 / n;                                               \
+  }
+
+BENCH(1)
+BENCH(2)
+BENCH(4)
+BENCH(8)
+BENCH(16)
+
+int main(int argc, char *argv[]) {
+  long n = argc > 1 ? atol(argv[1]) : 10000000;
+  if (n <= 0) {
+    fprintf(stderr, "usage: %s [lookups]\n", argv[0]);
+    return 1;
+  }
+
+  // Line addresses are distinct, about one line in eight is invalid.
+  srand(1);
+  for (int i = 0; i < LINES; i++) {
+    tags[i] = ((uint64_t)rand() << 32 | (uint64_t)i) << 6;
+    states[i] = rand() % 8 ? 1 + rand() % 3 : 0;
+    aos[i].address = tags[i];
+    aos[i].state = states[i];
+  }
+
+  struct query *q = (struct query *)malloc(sizeof(struct query) * n);
+  const int way_counts[] = {1, 2, 4, 8, 16};
+  void (*benches[])(const struct query *, long, double *) = {
+      bench_1, bench_2, bench_4, bench_8, bench_16};
+
+#if defined(__AVX2__)
+  const char *simd = "AVX2";
+#elif defined(__SSE4_1__)
+  const char *simd = "SSE4.1";
+#else
+  const char *simd = "scalar";
+#endif
+  printf("%5s %12s %12s %12s  (ns/lookup, vector kernel: %s)\n", "ways",
+         "AoS", "SoA scalar", "SoA vector", simd);
+  for (int k = 0; k < 5; k++) {
+    int ways = way_counts[k];
+    // Half of the lookups hit a random way of a random set.
+    for (long i = 0; i < n; i++) {
+      uint32_t base = (uint32_t)(rand() % (LINES / ways)) * ways;
+      q[i].base = base;
+      q[i].tag = rand() % 2 ? tags[base + rand() % ways] : (uint64_t)rand();
+    }
+    double ns[3];
+    benches[k](q, n, ns);
+    printf("%5d %12.2f %12.2f %12.2f\n", ways, ns[0], ns[1], ns[2]);
+  }
+  free(q);
+  return 0;
+}
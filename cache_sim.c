@@ -1,26 +1,20 @@
+#include<inttypes.h>
 #include<stdlib.h>
 #include<stdio.h>
 #include<omp.h>
 #include<string.h>
 #include<ctype.h>
 
-typedef char byte;
+#include "trace.h"
 
 struct cache {
-    byte address; // This is the address in memory.
+    uint64_t address; // This is the address in memory.
     byte value; // This is the value stored in cached memory.
     // State for you to implement MESI protocol.
     byte state;
 };
 
-struct decoded_inst {
-    int type; // 0 is RD, 1 is WR
-    byte address;
-    byte value; // Only used for WR 
-};
-
 typedef struct cache cache;
-typedef struct decoded_inst decoded;
 
 
 /*
@@ -32,34 +26,13 @@ typedef struct decoded_inst decoded;
  */
 
 byte * memory;
-
-// Decode instruction lines
-decoded decode_inst_line(char * buffer){
-    decoded inst;
-    char inst_type[2];
-    sscanf(buffer, "%s", inst_type);
-    if(!strcmp(inst_type, "RD")){
-        inst.type = 0;
-        int addr = 0;
-        sscanf(buffer, "%s %d", inst_type, &addr);
-        inst.value = -1;
-        inst.address = addr;
-    } else if(!strcmp(inst_type, "WR")){
-        inst.type = 1;
-        int addr = 0;
-        int val = 0;
-        sscanf(buffer, "%s %d %d", inst_type, &addr, &val);
-        inst.address = addr;
-        inst.value = val;
-    }
-    return inst;
-}
+int memory_size;
 
 // Helper function to print the cachelines
 void print_cachelines(cache * c, int cache_size){
     for(int i = 0; i < cache_size; i++){
         cache cacheline = *(c+i);
-        printf("Address: %d, State: %d, Value: %d\n", cacheline.address, cacheline.state, cacheline.value);
+        printf("Address: %" PRIu64 ", State: %d, Value: %d\n", cacheline.address, cacheline.state, cacheline.value);
     }
 }
 
@@ -68,14 +41,19 @@ void print_cachelines(cache * c, int cache_size){
 void cpu_loop(int num_threads){
     // Initialize a CPU level cache that holds about 2 bytes of data.
     int cache_size = 2;
-    cache * c = (cache *) malloc(sizeof(cache) * cache_size);
+    cache * c = (cache *) calloc(cache_size, sizeof(cache));
     
     // Read Input file
-    FILE * inst_file = fopen("input_0.txt", "r");
-    char inst_line[20];
+    // Text or binary traces are both accepted, see trace.h.
+    trace * inst_file = trace_open("input_0.txt", true);
+    decoded inst;
     // Decode instructions and execute them.
-    while (fgets(inst_line, sizeof(inst_line), inst_file)){
-        decoded inst = decode_inst_line(inst_line);
+    while (inst_file && trace_next(inst_file, &inst)){
+        // Only addresses inside memory can be cached.
+        if(inst.address >= (uint64_t)memory_size){
+            fprintf(stderr, "Address %" PRIu64 " is outside memory\n", inst.address);
+            continue;
+        }
         /*
          * Cache Replacement Algorithm
          */
@@ -100,22 +78,24 @@ void cpu_loop(int num_threads){
         }
         switch(inst.type){
             case 0:
-                printf("Reading from address %d: %d\n", cacheline.address, cacheline.value);
+                printf("Reading from address %" PRIu64 ": %d\n", cacheline.address, cacheline.value);
                 break;
             
             case 1:
-                printf("Writing to address %d: %d\n", cacheline.address, cacheline.value);
+                printf("Writing to address %" PRIu64 ": %d\n", cacheline.address, cacheline.value);
                 break;
         }
     }
+    if(inst_file)
+        trace_close(inst_file);
     free(c);
 }
 
 int main(int c, char * argv[]){
     // Initialize Global memory
     // Let's assume the memory module holds about 24 bytes of data.
-    int memory_size = 24;
-    memory = (byte *) malloc(sizeof(byte) * memory_size);
+    memory_size = 24;
+    memory = (byte *) calloc(memory_size, sizeof(byte));
     cpu_loop(1);
     free(memory);
 }
\ No newline at end of file
@@ -1,15 +1,77 @@
 /*
  * Filename: cache_sim.c
  * This is a very basic C cache simulator.
-  * The input files for each "Core" must be named core_1.txt, core_2.txt,
- * core_3.txt ... core_n.txt Input files consist of the following instructions:
+ * usage: cache_sim [options] [trace_0 trace_1 ... trace_n]
+ * Each trace file is run by its own "Core"; without arguments the traces are
+ * named by -t, input_0.txt and input_1.txt by default. Every option also has
+ * a long form (--sets 64), named as in long_options below. Options:
+ * -c config   apply a configuration file, see read_config()
+ * -n cores    number of simulated cores (default one per trace, or 2)
+ * -t pattern  trace of core N, %d standing for N (default input_%d.txt)
+ * -s          read traces through stdio instead of mapping them
+ * -d          directory coherence instead of snooping every core
+ * -p protocol coherence protocol: mesi (default), moesi or mesif
+ * -q quantum  instructions per core between clock synchronizations
+ *             (default 1, 0 for none)
+ * -l locks    number of set locks used for coherence (default one per set)
+ * -w workers  run the cores as tasks on this many host threads (default 0,
+ *             one host thread per core); see engine.h
+ * -F decoders threads decoding traces ahead of the cores (default 1, 0 to
+ *             decode on the cores); see frontend.h
+ * -S sets     sets per cache (default 2)
+ * -A ways     ways per set (default 1, direct mapped)
+ * -B bytes    line size (default 1)
+ * -2 S:A      private L2 per core with S sets of A ways
+ * -3 S:A[:N]  shared LLC with S sets of A ways in N banks (default 1)
+ * -I policy   LLC inclusion: inclusive (default), exclusive or nine; see
+ *             hierarchy.h
+ * -L lat=N,.. cycles per access step: l1, l2, llc, mem, c2c (another core
+ *             supplies the line), wb (write-back), inv (invalidation) and
+ *             link (a round trip to another socket)
+ * -N S[:B]    split the cores and memory over S sockets, interleaving memory
+ *             in B byte chunks (default 4096); see numa.h
+ * -f pf[:N],.. prefetchers fetching N lines ahead (default 1): next,
+ *             stride or stream; see prefetch.h
+ * -b entries  store buffer of this many entries per core (default 0, none)
+ * -m model    consistency model of the store buffers: tso (default) or sc;
+ *             see storebuf.h
+ * -r policy   replacement policy: fifo (default), lru, plru, srrip, brrip or
+ *             random; see replacement.h
+ * -o mode     per-access output: async (default), ordered by clock and core,
+ *             or quiet to print the statistics instead; see output.h
+ * -x file     export the statistics as JSON, or as CSV if file ends in .csv
+ * -H lines    profile contention per line and report the lines most often
+ *             handed between cores, and which are falsely shared; see
+ *             hotspot.h
+ * -C file     save a checkpoint to file at the end of the run, and with -K
+ *             every N instructions per core; see checkpoint.h
+ * -K insts    instructions per core between checkpoints (needs -q)
+ * -W insts    fast-forward the first insts instructions of every core: they
+ *             update the caches and memory, but aren't counted or printed
+ *             and run without clock synchronization
+ * -P D:G      sample: after the warmup, simulate D instructions per core in
+ *             detail, fast-forward G, and so on; the statistics then
+ *             estimate the totals, see stats.h
+ * -R file     restore a checkpoint and continue the run from it
+ * -Y file     record the order of the cores' accesses to file
+ * -Z file     replay a recorded order, which repeats that run exactly; see
+ *             replay.h
+ * Input files consist of the following instructions:
  * - RD <address>
  * - WR <address> <val>
+ * - CAS <address> <expected> <new>
+ * - FAA <address> <add>
+ * - FENCE
+ * with RD4 <address> and so on for 2, 4 and 8-byte accesses, see trace.h.
+ * Traces may also be in the binary format produced by trace_conv.
  *
  * compiling with DEBUG macro defined gives info about
  * cache and memory at each cycle and executes each core
  * atomically.
  */
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <omp.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -17,11 +79,24 @@
 #include <string.h>
 #include <threads.h>
 #include <unistd.h>
-typedef char byte;
 
-enum mesi_state { Invalid, Shared, Exclusive, Modified };
-
-typedef enum mesi_state mesi_state;
+#include "arena.h"
+#include "checkpoint.h"
+#include "coherence.h"
+#include "engine.h"
+#include "frontend.h"
+#include "hierarchy.h"
+#include "hotspot.h"
+#include "numa.h"
+#include "output.h"
+#include "prefetch.h"
+#include "replacement.h"
+#include "replay.h"
+#include "sparse_mem.h"
+#include "stats.h"
+#include "storebuf.h"
+#include "tag_match.h"
+#include "trace.h"
 
 #ifdef DEBUG
 #  define debug(...)                                                           \
@@ -31,78 +106,1372 @@ typedef enum mesi_state mesi_state;
 #  define debug(...)
 #endif
 
-struct cache {
-  byte address; // This is the address in memory.
-  byte value;   // This is the value stored in cached memory.
-  // State for you to implement MESI protocol.
-  mesi_state state;
+// debug output printed by core 0 only
+#define debug_core(core, ...)                                                  \
+  do {                                                                         \
+    if ((core) == 0) {                                                         \
+      debug(__VA_ARGS__);                                                      \
+    }                                                                          \
+  } while (0)
+
+// A core's private L1: geo.sets sets of geo.ways lines each, set-major.
+// Line state is kept as structure of arrays so that the tags of a set are
+// contiguous and can be matched with vector compares, see tag_match.h.
+struct core_cache {
+  uint64_t *tags;  // address in memory of the first byte of each line
+  uint8_t *states; // mesi_state of each line, plus TAG_MATCH_PAD bytes
+  byte *data;      // geo.line_size bytes per line
+  struct repl_state repl;
+  struct tag_cache l2; // only if l2_sets
+  // only if prefetching: per line whether it was prefetched and not used yet
+  uint8_t *prefetched;
+  struct prefetch_state *pf;
+  struct store_buffer sb;    // only if store_buffer_size
+  struct hotspot_table *hot; // only if hotspot_lines
+  int socket;                // see numa.h
 };
+typedef struct core_cache core_cache;
 
-struct decoded_inst {
-  int type; // 0 is RD, 1 is WR
-  byte address;
-  byte value; // Only used for WR
+// Geometry shared by every core's cache.
+struct geometry {
+  int sets;
+  int ways;
+  int line_size;
+  bool pow2;       // sets and line_size are powers of two
+  int offset_bits; // log2(line_size) if pow2
 };
-typedef struct cache cache;
-typedef struct decoded_inst decoded;
 
+struct geometry geo = {.sets = 2, .ways = 1, .line_size = 1};
 
-byte *memory;
+enum repl_policy repl_policy = REPL_FIFO;
 
-// Decode instruction lines
-decoded decode_inst_line(char *buffer) {
-  decoded inst;
-  char inst_type[2];
-  sscanf(buffer, "%s", inst_type);
-  if (!strcmp(inst_type, "RD")) {
-    inst.type = 0;
-    int addr = 0;
-    sscanf(buffer, "%s %d", inst_type, &addr);
-    inst.value = -1;
-    inst.address = addr;
-  } else if (!strcmp(inst_type, "WR")) {
-    inst.type = 1;
-    int addr = 0;
-    int val = 0;
-    sscanf(buffer, "%s %d %d", inst_type, &addr, &val);
-    inst.address = addr;
-    inst.value = val;
-  }
-  return inst;
+// Cycles each step of an access adds to its latency. Every access pays
+// LAT_L1. A fill supplied by another core pays LAT_C2C, any other fill pays
+// each lower level it looks up and LAT_MEM if none of them has the line. Each
+// write-back and each copy invalidated on behalf of the access adds on top,
+// and so does every trip to another socket, see numa.h.
+enum latency_event {
+  LAT_L1,
+  LAT_L2,
+  LAT_LLC,
+  LAT_MEM,
+  LAT_C2C,
+  LAT_WB,
+  LAT_INV,
+  LAT_LINK,
+  LATENCIES
+};
+const char *const latency_names[LATENCIES] = {
+    [LAT_L1] = "l1",   [LAT_L2] = "l2", [LAT_LLC] = "llc", [LAT_MEM] = "mem",
+    [LAT_C2C] = "c2c", [LAT_WB] = "wb", [LAT_INV] = "inv",
+    [LAT_LINK] = "link"};
+unsigned latency[LATENCIES] = {
+    [LAT_L1] = 4,   [LAT_L2] = 12, [LAT_LLC] = 40, [LAT_MEM] = 200,
+    [LAT_C2C] = 60, [LAT_WB] = 20, [LAT_INV] = 20, [LAT_LINK] = 100};
+
+// Set latencies from a list like "l1=4,mem=200". Returns false if it doesn't
+// parse.
+static bool parse_latencies(char *spec) {
+  for (char *item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+    char *value = strchr(item, '=');
+    if (!value)
+      return false;
+    *value++ = '\0';
+    int e = 0;
+    while (e < LATENCIES && strcmp(item, latency_names[e]))
+      e++;
+    if (e == LATENCIES || !*value)
+      return false;
+    latency[e] = atoi(value);
+  }
+  return true;
 }
 
+// Levels below the L1s, see hierarchy.h. A level is absent while its sets are
+// 0. They share the L1 line size and replacement policy.
+int l2_sets, l2_ways;
+int llc_sets, llc_ways, llc_banks = 1;
+enum inclusion llc_inclusion = INCL_INCLUSIVE;
+struct llc llc;
+
+
+// Bytes of memory shown by the DEBUG dumps.
+#define DEBUG_MEMORY_BYTES 24
+
+// Directory based coherence: one sharer bitmask per memory block, so writes
+// and read misses only visit the caches that actually hold the block instead
+// of snooping every core.
+bool use_directory = false;
+sparse directory;
+int dir_words;
+
+// Map trace files instead of reading them through stdio.
+bool use_mmap = true;
+
+// Instructions each core runs between global synchronization points. 1 keeps
+// all cores in lockstep; 0 is relaxed mode with no global clock at all.
+int sync_quantum = 1;
+
+// Transition table of the coherence protocol, indexed by state and event.
+enum coherence_protocol protocol = PROTO_MESI;
+const struct transition (*transitions)[EVENTS];
+
+// Host threads running the simulated cores through engine_run(). 0 runs each
+// core on its own OpenMP thread.
+int num_workers = 0;
+
+// Threads decoding traces ahead of the cores, see frontend.h. 0 leaves each
+// core to decode its own batches.
+int num_decoders = 1;
+
+// Number of coherence locks; set i is guarded by lock i % lock_stripes. 0
+// means one lock per set, 1 serializes all cores on a single global lock.
+int lock_stripes = 0;
+
+// Checkpoints saved to checkpoint_file every checkpoint_every instructions
+// per core (0 for only at the end), and the one to restore, if any.
+const char *checkpoint_file, *restore_file;
+uint64_t checkpoint_every;
+
+// Recording of the access order to write or to replay, see replay.h.
+const char *record_file, *replay_file;
+
+// Instructions per core run in fast-forward before the detailed simulation.
+uint64_t warmup;
+
+// Sampled simulation: each period of sample_detail + sample_gap instructions
+// after the warmup starts with a detailed window. Not sampled if 0.
+uint64_t sample_detail, sample_gap;
+
+#ifdef DEBUG
 // Helper function to print the cachelines
-void print_cachelines(cache *c, int cache_size) {
-  for (int i = 0; i < cache_size; i++) {
-    cache cacheline = *(c + i);
-    char state[10];
-    switch (cacheline.state) {
-    case Invalid:
-      strcpy(state, "Invalid");
-      break;
-    case Shared:
-      strcpy(state, "Shared");
-      break;
-    case Exclusive:
-      strcpy(state, "Exclusive");
+void print_cachelines(core_cache *cc) {
+  for (int i = 0; i < geo.sets * geo.ways; i++) {
+    debug("\t\tAddress: %" PRIu64 ", State: %s, Value:", cc->tags[i],
+          state_names[cc->states[i]]);
+    for (int b = 0; b < geo.line_size; b++) {
+      debug(" %d", cc->data[(size_t)i * geo.line_size + b]);
+    }
+    debug("\n");
+  }
+}
+#endif
+
+// Sharer bitmask of a block, dir_words 64-bit words long. Bit i is set while
+// core i holds the block in a valid state. Guarded by the lock of the set the
+// block maps to.
+static inline uint64_t *dir_sharers(uint64_t block) {
+  return (uint64_t *)sparse_get(&directory, block, true);
+}
+
+static inline void dir_add(uint64_t block, int core) {
+  dir_sharers(block)[core / 64] |= 1ULL << (core % 64);
+}
+
+static inline void dir_remove(uint64_t block, int core) {
+  dir_sharers(block)[core / 64] &= ~(1ULL << (core % 64));
+}
+
+/*
+ * The hot path below is written once with the associativity and the indexing
+ * mode as parameters, and always inlined into kernels where both are
+ * constants. The compiler then turns the way search into straight-line
+ * compares and the set index into a shift and mask. select_kernel() picks a
+ * kernel once per run, so there is no per-access dispatch.
+ */
+#define always_inline static inline __attribute__((always_inline))
+
+// The rare paths are kept out of the kernels, and run at the configured
+// geometry and policy like the lower levels.
+#define cold_path static __attribute__((noinline, cold))
+
+always_inline uint64_t block_of(uint64_t address, const bool pow2) {
+  return pow2 ? address >> geo.offset_bits : address / geo.line_size;
+}
+
+always_inline int set_of(uint64_t block, const bool pow2) {
+  return pow2 ? block & (geo.sets - 1) : block % geo.sets;
+}
+
+// Way of the set starting at line base holding line_addr in a valid state, or
+// -1.
+always_inline int find_way(const core_cache *cc, size_t base,
+                           uint64_t line_addr, const int ways) {
+  return tag_find(cc->tags + base, cc->states + base, line_addr, ways);
+}
+
+// Way to replace in a set: an invalid line if there is one, otherwise the
+// choice of the replacement policy.
+always_inline int pick_victim(core_cache *cc, int set, size_t base,
+                              const int ways, const enum repl_policy policy) {
+  int free_way = find_invalid(cc->states + base, ways);
+  if (free_way >= 0)
+    return free_way;
+  return repl_victim(&cc->repl, set, base, ways, policy);
+}
+
+// Data of line number line (set * ways + way) of a cache.
+always_inline byte *line_data(core_cache *cc, size_t line) {
+  return cc->data + line * geo.line_size;
+}
+
+// Outcome of showing a request to the other caches.
+struct snoop {
+  byte *supplier;      // data of the copy that supplies the line, if any
+  bool shared;         // some other cache kept a copy
+  bool remote;         // the request snooped a core on another socket
+  int socket;          // of the requesting core
+  int supplier_socket; // of the supplier
+};
+
+// Count a message of bytes from socket from to socket to into st. Messages
+// within a socket don't cross a link and aren't counted.
+always_inline void link_send(core_stats *st, int from, int to, int bytes) {
+  if (from == to)
+    return;
+  st->link_messages++;
+  st->link_bytes += bytes;
+  st->link[from][to] += bytes;
+}
+
+// Write the line at line back to memory from data in a cache on socket, on
+// behalf of the core counting into st.
+always_inline void write_back(uint64_t line, const byte *data, int socket,
+                              core_stats *st) {
+  mem_write(line, data, geo.line_size);
+  st->writebacks++;
+  st->cycles += latency[LAT_WB];
+  if (numa_sockets == 1)
+    return;
+  int home = numa_home(line);
+  st->mem_writes[home]++;
+  if (home != socket) {
+    st->remote_writebacks++;
+    st->cycles += latency[LAT_LINK];
+    link_send(st, socket, home, NUMA_CONTROL_BYTES + geo.line_size);
+  }
+}
+
+// Apply a snoop event to line of cache cc on behalf of the core counting into
+// st.
+always_inline void snoop_line(core_cache *cc, size_t line, int event,
+                              struct snoop *snoop, core_stats *st) {
+  struct transition t = transitions[cc->states[line]][event];
+  if (t.actions & ACT_WRITEBACK) {
+    debug("Writing back address %" PRIu64 "\n", cc->tags[line]);
+    write_back(cc->tags[line], line_data(cc, line), cc->socket, st);
+  }
+  if ((t.actions & ACT_SUPPLY) && !snoop->supplier) {
+    snoop->supplier = line_data(cc, line);
+    snoop->supplier_socket = cc->socket;
+  }
+  if (t.next == Invalid) {
+    debug("Invalidating address %" PRIu64 "\n", cc->tags[line]);
+    st->invalidations++;
+    st->cycles += latency[LAT_INV];
+    if (prefetching && cc->prefetched[line]) {
+      st->prefetch_killed++;
+      cc->prefetched[line] = 0;
+    }
+  } else {
+    snoop->shared = true;
+  }
+  cc->states[line] = t.next;
+}
+
+/*
+ * The lower levels only see L1 misses, so they run at the configured
+ * geometry and policy instead of being specialized into the kernels.
+ */
+
+// Set base of line in an L1 and in core's L2.
+static size_t l1_base(uint64_t line) {
+  return (size_t)(line / geo.line_size % geo.sets) * geo.ways;
+}
+
+static int l2_set(uint64_t line) { return line / geo.line_size % l2_sets; }
+
+// Invalidate line in L1 cc so that a lower level can drop it, writing back
+// its data if the protocol says so.
+static void l1_back_invalidate(core_cache *cc, uint64_t line,
+                               core_stats *st) {
+  size_t base = l1_base(line);
+  int w = tag_find(cc->tags + base, cc->states + base, line, geo.ways);
+  if (w < 0)
+    return;
+  if (transitions[cc->states[base + w]][EV_EVICT].actions & ACT_WRITEBACK)
+    write_back(line, line_data(cc, base + w), cc->socket, st);
+  cc->states[base + w] = Invalid;
+  if (prefetching && cc->prefetched[base + w]) {
+    st->prefetch_unused++;
+    cc->prefetched[base + w] = 0;
+  }
+  st->back_invalidations++;
+  st->cycles += latency[LAT_INV];
+}
+
+// Put line into the LLC, invalidating the line it replaces everywhere if the
+// LLC is inclusive.
+static void llc_put(core_cache *c, int num_threads, uint64_t line,
+                    core_stats *st) {
+  uint64_t victim;
+  if (!llc_insert(&llc, line / geo.line_size, line, repl_policy, &victim) ||
+      llc_inclusion != INCL_INCLUSIVE)
+    return;
+  for (int i = 0; i < num_threads; i++) {
+    l1_back_invalidate(&c[i], victim, st);
+    if (l2_sets)
+      tag_cache_remove(&c[i].l2, l2_set(victim), victim);
+  }
+  if (use_directory)
+    memset(dir_sharers(victim / geo.line_size), 0,
+           dir_words * sizeof(uint64_t));
+}
+
+// line has left the last private cache of core.
+static void private_evicted(core_cache *c, int num_threads, int core,
+                            uint64_t line, core_stats *st) {
+  if (use_directory)
+    dir_remove(line / geo.line_size, core);
+  if (llc_sets && llc_inclusion == INCL_EXCLUSIVE)
+    llc_put(c, num_threads, line, st);
+}
+
+// Put line into the L2 of core. The L2 is inclusive of the L1, so the line it
+// replaces leaves the L1 too.
+static void l2_put(core_cache *c, int num_threads, int core, uint64_t line,
+                   core_stats *st) {
+  uint64_t victim;
+  if (!tag_cache_insert(&c[core].l2, l2_set(line), line, repl_policy,
+                        &victim))
+    return;
+  l1_back_invalidate(&c[core], victim, st);
+  private_evicted(c, num_threads, core, victim, st);
+}
+
+// Bring line into the levels below the L1 of core as it fills the L1. Unless
+// another core supplied the line, counts the level that served it. Returns
+// whether one did rather than memory.
+static bool fill_below(core_cache *c, int num_threads, int core,
+                       uint64_t line, bool supplied, core_stats *st) {
+  bool found = supplied;
+  if (l2_sets) {
+    if (!found)
+      st->cycles += latency[LAT_L2];
+    if (tag_cache_lookup(&c[core].l2, l2_set(line), line, repl_policy,
+                         true)) {
+      st->l2_hits += !found;
+      found = true;
+    } else {
+      st->l2_misses += !found;
+      l2_put(c, num_threads, core, line, st);
+    }
+  }
+  if (llc_sets && !found) {
+    st->cycles += latency[LAT_LLC];
+    uint64_t block = line / geo.line_size;
+    if (llc_lookup(&llc, block, line, repl_policy, true)) {
+      st->llc_hits++;
+      found = true;
+      // the line moves up into the private caches
+      if (llc_inclusion == INCL_EXCLUSIVE)
+        llc_remove(&llc, block, line);
+    } else {
+      st->llc_misses++;
+      if (llc_inclusion != INCL_EXCLUSIVE)
+        llc_put(c, num_threads, line, st);
+    }
+  }
+  return found && !supplied;
+}
+
+// Show a snoop event to the private caches of another core. Lines that are
+// only left in its L2 are clean and count as shared copies.
+always_inline void snoop_caches(core_cache *cc, size_t base, uint64_t line,
+                                uint64_t block, const int ways, int event,
+                                struct snoop *snoop, core_stats *st) {
+  int w = find_way(cc, base, line, ways);
+  if (w >= 0)
+    snoop_line(cc, base + w, event, snoop, st);
+  if (!l2_sets)
+    return;
+  if (event == EV_SNOOP_WRITE) {
+    if (tag_cache_remove(&cc->l2, block % l2_sets, line) && w < 0) {
+      st->invalidations++;
+      st->cycles += latency[LAT_INV];
+    }
+  } else if (w < 0 &&
+             tag_cache_lookup(&cc->l2, block % l2_sets, line, repl_policy,
+                              false)) {
+    snoop->shared = true;
+  }
+}
+
+// snoop_caches() of a core on any socket: the request and its answer cross
+// the link if the core is on another socket than the requester.
+always_inline void snoop_core(core_cache *cc, size_t base, uint64_t line,
+                              uint64_t block, const int ways, int event,
+                              struct snoop *snoop, core_stats *st) {
+  uint64_t invalidations = st->invalidations;
+  snoop_caches(cc, base, line, block, ways, event, snoop, st);
+  if (cc->socket == snoop->socket)
+    return;
+  snoop->remote = true;
+  st->remote_invalidated += st->invalidations - invalidations;
+  link_send(st, snoop->socket, cc->socket, NUMA_CONTROL_BYTES);
+  link_send(st, cc->socket, snoop->socket, NUMA_CONTROL_BYTES);
+}
+
+// Address of the first byte of the line holding address.
+always_inline uint64_t line_of(uint64_t address, const bool pow2) {
+  uint64_t block = block_of(address, pow2);
+  return pow2 ? block << geo.offset_bits : block * geo.line_size;
+}
+
+// Lock guarding the set of line, see lock_stripes.
+always_inline int stripe_of(uint64_t line, const bool pow2) {
+  return set_of(block_of(line, pow2), pow2) % lock_stripes;
+}
+
+// Take the lock of stripe for core, in the recorded order when replaying.
+always_inline void lock_stripe(omp_lock_t *set_locks, int stripe, int core) {
+  if (replay_mode == REPLAY_REPLAY)
+    replay_wait(stripe, core);
+  omp_set_lock(&set_locks[stripe]);
+  if (replay_mode != REPLAY_OFF)
+    replay_access(stripe, core);
+}
+
+// Little endian value of the size bytes at p.
+static inline uint64_t load_le(const byte *p, int size) {
+  uint64_t v = 0;
+  for (int i = size - 1; i >= 0; i--)
+    v = v << 8 | (uint8_t)p[i];
+  return v;
+}
+
+static inline void store_le(byte *p, uint64_t v, int size) {
+  for (int i = 0; i < size; i++, v >>= 8)
+    p[i] = (byte)v;
+}
+
+// The value of a size byte access as a signed number, as it is printed.
+static inline int64_t sign_extend(uint64_t v, int size) {
+  int shift = 64 - 8 * size;
+  return (int64_t)(v << shift) >> shift;
+}
+
+// Bring the line at line_addr into the L1 of core for an access of type and
+// keep the other caches coherent. The caller holds the lock of the line's
+// set, which covers the set in every core's cache, and memory for every
+// block mapping to the set, which includes any victim being flushed. Lines
+// move between caches and memory as whole blocks of geo.line_size bytes.
+// Writes and atomics get the line Modified. Counts the hit or miss, sets
+// *trigger if the access should train the prefetchers on a miss and returns
+// the line's data. An INST_PREFETCH fills the line like a read miss, unless
+// the L1 already holds it, without costing the core any cycles, and returns
+// NULL.
+always_inline byte *access_line(core_cache *c, int num_threads, int core,
+                                core_stats *st, uint64_t line_addr, int type,
+                                bool *trigger, const int ways,
+                                const bool pow2,
+                                const enum repl_policy policy) {
+  uint64_t block = block_of(line_addr, pow2);
+  int set = set_of(block, pow2);
+  size_t base = (size_t)set * ways;
+
+  uint64_t start = st->cycles;
+  st->cycles += latency[LAT_L1];
+  int way = find_way(&c[core], base, line_addr, ways);
+  bool hit = way >= 0;
+  bool prefetch = type == INST_PREFETCH;
+  bool write = type != INST_READ && !prefetch;
+  *trigger = !hit;
+  if (prefetch) {
+    if (hit) {
+      st->prefetch_hits++;
+      st->cycles = start;
+      return NULL;
+    }
+    st->prefetches++;
+  } else if (write) {
+    st->write_hits += hit;
+    st->write_misses += !hit;
+  } else {
+    st->read_hits += hit;
+    st->read_misses += !hit;
+  }
+  if (!hit) {
+    // replace a cacheline of the set
+    way = pick_victim(&c[core], set, base, ways, policy);
+    uint64_t victim = c[core].tags[base + way];
+    uint8_t victim_state = c[core].states[base + way];
+    st->evictions += victim_state != Invalid;
+    struct transition evict = transitions[victim_state][EV_EVICT];
+    if (evict.actions & ACT_WRITEBACK) {
+      debug("Flushing cacheline at address %" PRIu64 " to memory\n", victim);
+      write_back(victim, line_data(&c[core], base + way), c[core].socket,
+                 st);
+    }
+    // With an L2 the victim stays in the core's private caches.
+    if (victim_state != Invalid && !l2_sets)
+      private_evicted(c, num_threads, core, victim, st);
+    c[core].tags[base + way] = line_addr;
+    c[core].states[base + way] = Invalid;
+    if (prefetching) {
+      st->prefetch_unused += c[core].prefetched[base + way];
+      c[core].prefetched[base + way] = prefetch;
+    }
+    repl_fill(&c[core].repl, set, base, way, ways, policy);
+  } else {
+    repl_hit(&c[core].repl, set, base, way, ways, policy);
+    if (prefetching && c[core].prefetched[base + way]) {
+      st->prefetch_useful++;
+      c[core].prefetched[base + way] = 0;
+      *trigger = true;
+    }
+  }
+  uint8_t *state = &c[core].states[base + way];
+  byte *data = line_data(&c[core], base + way);
+
+  struct transition t = transitions[*state][write ? EV_WRITE : EV_READ];
+  if (t.actions) {
+    // Every other copy sees the request. On a read the first copy that
+    // supplies the line is enough, all later ones only answer Shared.
+    int event = t.actions & ACT_INVALIDATE ? EV_SNOOP_WRITE : EV_SNOOP_READ;
+    int socket = c[core].socket;
+    struct snoop snoop = {NULL, false, false, socket, socket};
+    uint64_t invalidations = st->invalidations;
+    if (use_directory) {
+      // only the sharers recorded in the directory hold the line
+      uint64_t *sharers = dir_sharers(block);
+      for (int w = 0; w < dir_words; w++) {
+        for (uint64_t bits = sharers[w]; bits; bits &= bits - 1) {
+          int i = w * 64 + __builtin_ctzll(bits);
+          if (i == core)
+            continue;
+          st->snoops++;
+          snoop_core(&c[i], base, line_addr, block, ways, event, &snoop, st);
+          if (event == EV_SNOOP_READ && snoop.supplier)
+            goto snooped;
+        }
+        if (event == EV_SNOOP_WRITE)
+          sharers[w] = 0;
+      }
+    snooped:
+      dir_add(block, core);
+    } else if (llc_sets && llc_inclusion == INCL_INCLUSIVE &&
+               !llc_lookup(&llc, block, line_addr, repl_policy, false)) {
+      // no private cache holds a line the inclusive LLC doesn't have
+      st->snoops_filtered++;
+    } else {
+      // iterate over the other caches
+      for (int i = 0; i < num_threads; i++) {
+        if (i == core)
+          continue;
+        st->snoops++;
+        snoop_core(&c[i], base, line_addr, block, ways, event, &snoop, st);
+      }
+    }
+
+    // The snoops of other sockets go out in parallel.
+    if (snoop.remote)
+      st->cycles += latency[LAT_LINK];
+
+    // Whether the home node served the line, and whether it was looked up.
+    bool from_home = false, at_home = use_directory;
+    if (t.actions & ACT_FETCH) {
+      if (snoop.supplier) {
+        memcpy(data, snoop.supplier, geo.line_size);
+        st->c2c_transfers++;
+        st->cycles += latency[LAT_C2C];
+        if (snoop.supplier_socket != socket) {
+          st->remote_transfers++;
+          link_send(st, snoop.supplier_socket, socket,
+                    NUMA_CONTROL_BYTES + geo.line_size);
+        }
+      } else {
+        // fetch data from mem
+        mem_read(line_addr, data, geo.line_size);
+      }
+      uint64_t l2_hits = st->l2_hits;
+      bool below = (l2_sets || llc_sets) &&
+                   fill_below(c, num_threads, core, line_addr,
+                              snoop.supplier != NULL, st);
+      from_home = !snoop.supplier && st->l2_hits == l2_hits;
+      at_home |= from_home;
+      if (!snoop.supplier && !below) {
+        st->mem_fills++;
+        st->cycles += latency[LAT_MEM];
+        if (numa_sockets > 1)
+          st->mem_reads[numa_home(line_addr)]++;
+      }
+    } else {
+      st->upgrades++;
+    }
+    int home = numa_sockets > 1 ? numa_home(line_addr) : socket;
+    if (at_home && home != socket) {
+      st->remote_fills += from_home;
+      st->cycles += latency[LAT_LINK];
+      link_send(st, socket, home, NUMA_CONTROL_BYTES);
+      link_send(st, home, socket,
+                NUMA_CONTROL_BYTES + (from_home ? geo.line_size : 0));
+    }
+    if (hotspot_lines)
+      hotspot_coherence(c[core].hot, line_addr, geo.line_size,
+                        st->invalidations - invalidations,
+                        snoop.supplier != NULL);
+    if (!write) {
+      debug("Read Miss\n");
+      t = transitions[Invalid][snoop.shared ? EV_FILL_SHARED : EV_FILL];
+    }
+  }
+  *state = t.next;
+  if (prefetch) {
+    st->cycles = start;
+    return NULL;
+  }
+  return data;
+}
+
+// Perform inst on its bytes at p, on a line held in a state that allows it.
+// Returns the value read or written, or the value an atomic found.
+always_inline uint64_t perform(decoded inst, byte *p, core_stats *st) {
+  uint64_t old = load_le(p, inst.size);
+  switch (inst.type) {
+  case INST_WRITE:
+    store_le(p, inst.value, inst.size);
+    return inst.value;
+  case INST_CAS:
+    // only the low inst.size bytes of the expected value count
+    if ((old ^ inst.value) << (64 - 8 * inst.size)) {
+      st->cas_failures++;
+      return old;
+    }
+    store_le(p, inst.operand, inst.size);
+    return old;
+  case INST_FAA:
+    store_le(p, old + inst.value, inst.size);
+    return old;
+  default:
+    return old;
+  }
+}
+
+// Count a demand instruction of type that took cycles.
+always_inline void count_inst(core_stats *st, int type, uint64_t cycles) {
+  st->reads += type == INST_READ;
+  st->writes += type == INST_WRITE;
+  st->atomics += type == INST_CAS || type == INST_FAA;
+  stats_latency(st, cycles);
+}
+
+// execute_inst() for an instruction whose bytes straddle lines: one access
+// per line, all of them under their set locks, taken in ascending order.
+// The atomics acquire every line before they compare or add, so they update
+// all of their bytes at once.
+cold_path uint64_t execute_split(core_cache *c, omp_lock_t *set_locks,
+                                 int num_threads, int core, core_stats *st,
+                                 decoded inst, bool *trigger) {
+  const int ways = geo.ways;
+  const bool pow2 = geo.pow2;
+  const enum repl_policy policy = repl_policy;
+  uint64_t lines[INST_MAX_SIZE];
+  int stripes[INST_MAX_SIZE], parts = 0, locks = 0;
+  for (uint64_t a = inst.address; a < inst.address + inst.size;
+       a = lines[parts - 1] + geo.line_size) {
+    lines[parts++] = line_of(a, pow2);
+    int stripe = stripe_of(lines[parts - 1], pow2), i = locks;
+    while (i && stripes[i - 1] > stripe)
+      i--;
+    if (i && stripes[i - 1] == stripe)
+      continue;
+    memmove(stripes + i + 1, stripes + i, sizeof(int) * (locks - i));
+    stripes[i] = stripe;
+    locks++;
+  }
+
+  uint64_t start = st->cycles;
+  for (int i = 0; i < locks; i++)
+    lock_stripe(set_locks, stripes[i], core);
+  byte bytes[INST_MAX_SIZE];
+  bool atomic = inst.type == INST_CAS || inst.type == INST_FAA;
+  if (inst.type == INST_WRITE)
+    store_le(bytes, inst.value, inst.size);
+  *trigger = false;
+  for (int i = 0; i < parts; i++) {
+    bool t;
+    byte *data = access_line(c, num_threads, core, st, lines[i], inst.type,
+                             &t, ways, pow2, policy);
+    *trigger |= t;
+    for (uint64_t a = lines[i] > inst.address ? lines[i] : inst.address;
+         a < lines[i] + geo.line_size && a < inst.address + inst.size; a++) {
+      if (inst.type == INST_WRITE)
+        data[a - lines[i]] = bytes[a - inst.address];
+      else
+        bytes[a - inst.address] = data[a - lines[i]];
+    }
+  }
+  uint64_t value = load_le(bytes, inst.size);
+  if (atomic) {
+    value = perform(inst, bytes, st);
+    // The later lines may have evicted the earlier ones, which are then
+    // fetched again; no other core gets them in between.
+    for (int i = 0; i < parts; i++) {
+      size_t base = (size_t)set_of(block_of(lines[i], pow2), pow2) * ways;
+      int w = find_way(&c[core], base, lines[i], ways);
+      bool t;
+      byte *data = w >= 0 ? line_data(&c[core], base + w)
+                          : access_line(c, num_threads, core, st, lines[i],
+                                        inst.type, &t, ways, pow2, policy);
+      for (uint64_t a = lines[i] > inst.address ? lines[i] : inst.address;
+           a < lines[i] + geo.line_size && a < inst.address + inst.size; a++)
+        data[a - lines[i]] = bytes[a - inst.address];
+    }
+  }
+  for (int i = locks - 1; i >= 0; i--)
+    omp_unset_lock(&set_locks[stripes[i]]);
+  st->split_accesses++;
+  count_inst(st, inst.type, st->cycles - start);
+  return value;
+}
+
+// Run one instruction on core and keep the other caches coherent. Each line
+// it touches is accessed holding the lock of the line's set, so every
+// interleaving of cores leaves the caches in a state some sequential order
+// would have produced, and an atomic finds and updates its bytes with no
+// other core's access in between. Returns the value read or written, or the
+// value an atomic found, and sets *trigger if the access should train the
+// prefetchers on a miss.
+always_inline uint64_t execute_inst(core_cache *c, omp_lock_t *set_locks,
+                                    int num_threads, int core,
+                                    core_stats *st, decoded inst,
+                                    bool *trigger, const int ways,
+                                    const bool pow2,
+                                    const enum repl_policy policy) {
+  uint64_t line_addr = line_of(inst.address, pow2);
+  int offset = inst.address - line_addr;
+  if (offset + inst.size > geo.line_size)
+    return execute_split(c, set_locks, num_threads, core, st, inst, trigger);
+  int stripe = stripe_of(line_addr, pow2);
+  uint64_t start = st->cycles;
+  lock_stripe(set_locks, stripe, core);
+  byte *data = access_line(c, num_threads, core, st, line_addr, inst.type,
+                           trigger, ways, pow2, policy);
+  uint64_t value = data ? perform(inst, data + offset, st) : 0;
+  omp_unset_lock(&set_locks[stripe]);
+  if (data)
+    count_inst(st, inst.type, st->cycles - start);
+  return value;
+}
+
+// Let the prefetchers of core see its access to address, and fetch the lines
+// they propose.
+always_inline void prefetch_after(core_cache *c, omp_lock_t *set_locks,
+                                  int num_threads, int core, core_stats *st,
+                                  uint64_t address, bool trigger,
+                                  const int ways, const bool pow2,
+                                  const enum repl_policy policy) {
+  uint64_t blocks[PREFETCH_MAX];
+  int n = prefetch_train(c[core].pf, block_of(address, pow2), trigger,
+                         blocks);
+  for (int i = 0; i < n; i++) {
+    decoded pf = {.address = blocks[i] * geo.line_size,
+                  .type = INST_PREFETCH,
+                  .size = 1};
+    bool ignored;
+    execute_inst(c, set_locks, num_threads, core, st, pf, &ignored, ways,
+                 pow2, policy);
+  }
+}
+
+// Perform the buffered stores of core in order, each starting when the one
+// before has finished: those started by the core's current cycle, or all of
+// them, with the core waiting for the last one.
+cold_path void drain_stores(core_cache *c, omp_lock_t *set_locks,
+                            int num_threads, int core, core_stats *st,
+                            bool all) {
+  const int ways = geo.ways;
+  const bool pow2 = geo.pow2;
+  const enum repl_policy policy = repl_policy;
+  struct store_buffer *sb = &c[core].sb;
+  while (sb->len) {
+    struct store_entry *e = sb_head(sb);
+    uint64_t start = sb->busy_until > e->ready ? sb->busy_until : e->ready;
+    if (!all && start > st->cycles)
       break;
-    case Modified:
-      strcpy(state, "Modified");
+    // The store runs behind the core, which doesn't spend its cycles.
+    uint64_t now = st->cycles;
+    int stripe = stripe_of(e->line, pow2);
+    bool ignored;
+    lock_stripe(set_locks, stripe, core);
+    byte *data = access_line(c, num_threads, core, st, e->line, INST_WRITE,
+                             &ignored, ways, pow2, policy);
+    for (int i = 0; i < geo.line_size; i++) {
+      if (e->written[i])
+        data[i] = e->data[i];
+    }
+    omp_unset_lock(&set_locks[stripe]);
+    stats_latency(st, st->cycles - now);
+    sb->busy_until = start + (st->cycles - now);
+    st->cycles = now;
+    sb_pop(sb);
+  }
+  if (all && sb->busy_until > st->cycles) {
+    st->sb_stall_cycles += sb->busy_until - st->cycles;
+    st->cycles = sb->busy_until;
+  }
+}
+
+// Put a store of core into its store buffer, one entry per line it writes.
+cold_path uint64_t buffer_store(core_cache *c, omp_lock_t *set_locks,
+                                int num_threads, int core, core_stats *st,
+                                decoded inst) {
+  const bool pow2 = geo.pow2;
+  struct store_buffer *sb = &c[core].sb;
+  uint64_t start = st->cycles;
+  byte bytes[INST_MAX_SIZE];
+  store_le(bytes, inst.value, inst.size);
+  for (int done = 0, len; done < inst.size; done += len) {
+    uint64_t line_addr = line_of(inst.address + done, pow2);
+    int offset = inst.address + done - line_addr;
+    len = geo.line_size - offset < inst.size - done ? geo.line_size - offset
+                                                    : inst.size - done;
+    struct store_entry *tail =
+        &sb->entries[(sb->head + sb->len - 1 + sb->size) % sb->size];
+    if (sb->len == sb->size && tail->line != line_addr) {
+      // wait for the oldest store to start, which frees its entry
+      struct store_entry *e = sb_head(sb);
+      uint64_t free_at = sb->busy_until > e->ready ? sb->busy_until : e->ready;
+      if (free_at > st->cycles) {
+        st->sb_stall_cycles += free_at - st->cycles;
+        st->cycles = free_at;
+      }
+      drain_stores(c, set_locks, num_threads, core, st, false);
+    }
+    st->sb_coalesced += sb_push(sb, line_addr, offset, bytes + done, len,
+                                st->cycles + latency[LAT_L1]);
+    st->split_accesses += done > 0;
+  }
+  st->writes++;
+  st->cycles += latency[LAT_L1];
+  stats_latency(st, st->cycles - start);
+  return inst.value;
+}
+
+// Run one instruction of core through its store buffer, if it has one. A
+// fence and every atomic wait for the buffered stores to drain, as a read
+// does under SC. Under TSO a read is forwarded from the buffer if all of its
+// bytes are buffered, bypasses it if none are, and otherwise waits for it.
+// See execute_inst() for the arguments.
+always_inline uint64_t core_access(core_cache *c, omp_lock_t *set_locks,
+                                   int num_threads, int core,
+                                   core_stats *st, decoded inst,
+                                   bool *trigger, const int ways,
+                                   const bool pow2,
+                                   const enum repl_policy policy) {
+  if (inst.type == INST_FENCE) {
+    st->fences++;
+    if (store_buffer_size)
+      drain_stores(c, set_locks, num_threads, core, st, true);
+    *trigger = false;
+    return 0;
+  }
+  if (!store_buffer_size)
+    return execute_inst(c, set_locks, num_threads, core, st, inst, trigger,
+                        ways, pow2, policy);
+  struct store_buffer *sb = &c[core].sb;
+  if (sb->len)
+    drain_stores(c, set_locks, num_threads, core, st, false);
+  if (inst.type == INST_WRITE) {
+    *trigger = false;
+    return buffer_store(c, set_locks, num_threads, core, st, inst);
+  }
+  int found = 0;
+  if (inst.type == INST_READ && consistency == CONS_TSO) {
+    byte bytes[INST_MAX_SIZE];
+    for (int i = 0; i < inst.size; i++) {
+      uint64_t line_addr = line_of(inst.address + i, pow2);
+      found += sb_forward(sb, line_addr, inst.address + i - line_addr,
+                          &bytes[i]);
+    }
+    if (found == inst.size) {
+      st->reads++;
+      st->sb_forwards++;
+      st->cycles += latency[LAT_L1];
+      stats_latency(st, latency[LAT_L1]);
+      *trigger = false;
+      return load_le(bytes, inst.size);
+    }
+  }
+  if (found || inst.type != INST_READ || consistency == CONS_SC)
+    drain_stores(c, set_locks, num_threads, core, st, true);
+  return execute_inst(c, set_locks, num_threads, core, st, inst, trigger,
+                      ways, pow2, policy);
+}
+
+// Run up to max instructions from the decoded trace of core, or all of them
+// if max is 0. *clock counts the instructions the core has executed. Unless
+// detailed, the instructions are fast-forwarded: they change the caches and
+// memory, but their statistics are thrown away and they aren't printed.
+// Returns false once the trace is exhausted.
+always_inline bool run_insts(core_cache *c, omp_lock_t *set_locks,
+                             int num_threads, int core,
+                             struct frontend_cursor *cur, int max,
+                             uint64_t *clock, bool detailed, const int ways,
+                             const bool pow2, const enum repl_policy policy) {
+  // Fast-forwarding takes none of the core's time. It counts from the core's
+  // clock, and the times of the store buffer are moved back by the cycles it
+  // spent once it is done, so the buffer comes out as it went in.
+  static _Thread_local core_stats discarded;
+  core_stats *st = stats[core];
+  if (!detailed) {
+    discarded.cycles = st->cycles;
+    st = &discarded;
+  }
+  decoded inst;
+  bool trigger, more = true;
+  if (hotspot_lines)
+    c[core].hot->recording = detailed;
+  for (int n = 0; !max || n < max; n++) {
+    if (!frontend_next(core, cur, &inst)) {
+      // the buffered stores still reach the caches
+      if (store_buffer_size)
+        drain_stores(c, set_locks, num_threads, core, st, true);
+      more = false;
       break;
     }
-    debug("\t\tAddress: %d, State: %s, Value: %d\n", cacheline.address, state,
-          cacheline.value);
+
+#ifdef DEBUG
+    if (!detailed) {
+      core_access(c, set_locks, num_threads, core, st, inst, &trigger, ways,
+                  pow2, policy);
+      if (prefetching && inst.type != INST_FENCE)
+        prefetch_after(c, set_locks, num_threads, core, st, inst.address,
+                       trigger, ways, pow2, policy);
+      ++*clock;
+      continue;
+    }
+    // Debug dumps show the caches right after each access, so print in line
+    // instead of going through the output rings.
+#  pragma omp critical(test)
+    {
+      int64_t value = sign_extend(core_access(c, set_locks, num_threads, core,
+                                              st, inst, &trigger, ways, pow2,
+                                              policy),
+                                  inst.size);
+      if (prefetching && inst.type != INST_FENCE)
+        prefetch_after(c, set_locks, num_threads, core, st, inst.address,
+                       trigger, ways, pow2, policy);
+      if (hotspot_lines && inst.type != INST_FENCE)
+        hotspot_access(c[core].hot, inst.address, inst.size,
+                       inst.type != INST_READ, geo.line_size);
+      switch (inst.type) {
+      case INST_READ:
+        printf("Core %d Reading from address %02" PRIu64 ": %02" PRId64 "\n",
+               core, inst.address, value);
+        break;
+
+      case INST_WRITE:
+        printf("Core %d Writing   to address %02" PRIu64 ": %02" PRId64 "\n",
+               core, inst.address, value);
+        break;
+
+      case INST_CAS:
+        printf("Core %d Swapping  at address %02" PRIu64 ": %02" PRId64 "\n",
+               core, inst.address, value);
+        break;
+
+      case INST_FAA:
+        printf("Core %d Adding    to address %02" PRIu64 ": %02" PRId64 "\n",
+               core, inst.address, value);
+        break;
+
+      case INST_FENCE:
+        printf("Core %d Fence\n", core);
+        break;
+      }
+      debug("Memory: ");
+      byte dump[DEBUG_MEMORY_BYTES];
+      mem_read(0, dump, sizeof(dump));
+      for (int i = 0; i < DEBUG_MEMORY_BYTES; i++) {
+        debug("%02d:%02d ", i, dump[i]);
+      }
+      debug("\n");
+      for (int i = 0; i < num_threads; i++) {
+        debug("\tCore %d\n", i);
+        print_cachelines(&c[i]);
+        debug("\n");
+      }
+    }
+#else
+    uint64_t value = core_access(c, set_locks, num_threads, core, st, inst,
+                                 &trigger, ways, pow2, policy);
+    if (prefetching && inst.type != INST_FENCE)
+      prefetch_after(c, set_locks, num_threads, core, st, inst.address,
+                     trigger, ways, pow2, policy);
+    if (hotspot_lines && inst.type != INST_FENCE)
+      hotspot_access(c[core].hot, inst.address, inst.size,
+                     inst.type != INST_READ, geo.line_size);
+    if (detailed)
+      output_event(core, *clock, inst.type, inst.address,
+                   sign_extend(value, inst.size));
+#endif
+    ++*clock;
+  }
+  if (!detailed && store_buffer_size)
+    sb_rebase(&c[core].sb, discarded.cycles - stats[core]->cycles);
+  return more;
+}
+
+typedef bool (*run_kernel)(core_cache *c, omp_lock_t *set_locks,
+                           int num_threads, int core,
+                           struct frontend_cursor *cur, int max,
+                           uint64_t *clock, bool detailed);
+
+#define RUN_KERNEL(name, ways, pow2, policy)                                   \
+  static bool name(core_cache *c, omp_lock_t *set_locks, int num_threads,     \
+                   int core, struct frontend_cursor *cur, int max,            \
+                   uint64_t *clock, bool detailed) {                           \
+    return run_insts(c, set_locks, num_threads, core, cur, max, clock,        \
+                     detailed, ways, pow2, policy);                            \
+  }
+
+// Kernels for one geometry, as a table indexed by replacement policy.
+#define RUN_KERNELS(name, ways, pow2)                                          \
+  RUN_KERNEL(name##_fifo, ways, pow2, REPL_FIFO)                               \
+  RUN_KERNEL(name##_lru, ways, pow2, REPL_LRU)                                 \
+  RUN_KERNEL(name##_plru, ways, pow2, REPL_PLRU)                               \
+  RUN_KERNEL(name##_srrip, ways, pow2, REPL_SRRIP)                             \
+  RUN_KERNEL(name##_brrip, ways, pow2, REPL_BRRIP)                             \
+  RUN_KERNEL(name##_random, ways, pow2, REPL_RANDOM)                           \
+  static const run_kernel name[REPL_POLICIES] = {                              \
+      [REPL_FIFO] = name##_fifo,     [REPL_LRU] = name##_lru,                  \
+      [REPL_PLRU] = name##_plru,     [REPL_SRRIP] = name##_srrip,              \
+      [REPL_BRRIP] = name##_brrip,   [REPL_RANDOM] = name##_random,            \
+  };
+
+// A direct mapped cache has nothing to choose from, so it needs no policy.
+RUN_KERNEL(run_direct_mapped, 1, true, REPL_FIFO)
+RUN_KERNELS(run_2way, 2, true)
+RUN_KERNELS(run_4way, 4, true)
+RUN_KERNELS(run_8way, 8, true)
+RUN_KERNELS(run_16way, 16, true)
+RUN_KERNELS(run_generic, geo.ways, false)
+
+// Pick the hot loop specialized for the configured geometry and policy.
+static run_kernel select_kernel(void) {
+  if (geo.ways == 1)
+    return geo.pow2 ? run_direct_mapped : run_generic_fifo;
+  if (geo.pow2) {
+    switch (geo.ways) {
+    case 2:
+      return run_2way[repl_policy];
+    case 4:
+      return run_4way[repl_policy];
+    case 8:
+      return run_8way[repl_policy];
+    case 16:
+      return run_16way[repl_policy];
+    }
+  }
+  return run_generic[repl_policy];
+}
+
+static bool is_pow2(int n) { return n > 0 && !(n & (n - 1)); }
+
+// Statistics export file, none if NULL.
+char *stats_file = NULL;
+
+// The caches and the kernel the cores run on.
+struct simulation {
+  core_cache *c;
+  omp_lock_t *set_locks;
+  int num_threads;
+  run_kernel run;
+  uint64_t *clocks; // instructions run by each core
+  // engine mode only: trace position of each core
+  struct frontend_cursor *cursors;
+};
+
+// Save the state of the whole simulation to path, or restore it from there.
+// The configuration comes first, so that a checkpoint only restores into the
+// configuration that saved it.
+static bool checkpoint_state(struct simulation *sim, const char *path,
+                             bool restore) {
+  struct checkpoint ck;
+  if (!ckpt_open(&ck, path, restore))
+    return false;
+  ckpt_match(&ck, sim->num_threads, "cores");
+  ckpt_match(&ck, geo.sets, "sets");
+  ckpt_match(&ck, geo.ways, "ways");
+  ckpt_match(&ck, geo.line_size, "line size");
+  ckpt_match(&ck, l2_sets, "L2 sets");
+  ckpt_match(&ck, l2_ways, "L2 ways");
+  ckpt_match(&ck, llc_sets, "LLC sets");
+  ckpt_match(&ck, llc_ways, "LLC ways");
+  ckpt_match(&ck, llc_banks, "LLC banks");
+  ckpt_match(&ck, llc_inclusion, "inclusion");
+  ckpt_match(&ck, protocol, "protocol");
+  ckpt_match(&ck, repl_policy, "replacement policy");
+  ckpt_match(&ck, use_directory, "directory");
+  ckpt_match(&ck, warmup, "warmup");
+  ckpt_match(&ck, sample_detail, "sample window");
+  ckpt_match(&ck, sample_gap, "sample gap");
+  for (int pf = 0; pf < PREFETCHERS; pf++)
+    ckpt_match(&ck, prefetch_degree[pf], "prefetch degree");
+  ckpt_match(&ck, store_buffer_size, "store buffer size");
+  ckpt_match(&ck, hotspot_lines > 0, "hotspot profile");
+  ckpt_match(&ck, numa_sockets, "sockets");
+  ckpt_match(&ck, numa_interleave, "interleave");
+
+  size_t lines = (size_t)geo.sets * geo.ways;
+  for (int core = 0; core < sim->num_threads; core++) {
+    core_cache *cc = &sim->c[core];
+    ckpt_u64(&ck, &sim->clocks[core]);
+    ckpt_bytes(&ck, cc->tags, sizeof(uint64_t) * lines);
+    ckpt_bytes(&ck, cc->states, lines);
+    ckpt_bytes(&ck, cc->data, lines * geo.line_size);
+    repl_checkpoint(&ck, &cc->repl, geo.sets, geo.ways);
+    if (l2_sets)
+      tag_cache_checkpoint(&ck, &cc->l2);
+    if (prefetching) {
+      ckpt_bytes(&ck, cc->prefetched, lines);
+      ckpt_bytes(&ck, cc->pf, sizeof(struct prefetch_state));
+    }
+    if (store_buffer_size)
+      sb_checkpoint(&ck, &cc->sb);
+    if (hotspot_lines)
+      ckpt_bytes(&ck, cc->hot, sizeof(struct hotspot_table));
+    ckpt_bytes(&ck, stats[core], sizeof(core_stats));
+  }
+  if (llc_sets)
+    llc_checkpoint(&ck, &llc);
+  mem_checkpoint(&ck);
+  if (use_directory)
+    sparse_checkpoint(&ck, &directory);
+  if (sample_detail)
+    stats_sample_checkpoint(&ck);
+  return ckpt_close(&ck);
+}
+
+// Whether a checkpoint is due after sync round round.
+static bool checkpoint_due(int round) {
+  if (!checkpoint_file || !checkpoint_every)
+    return false;
+  uint64_t rounds = checkpoint_every / sync_quantum;
+  return (round + 1) % (rounds ? rounds : 1) == 0;
+}
+
+// engine_epoch saving the checkpoints that are due.
+static void epoch_done(int epoch, void *arg) {
+  if (checkpoint_due(epoch))
+    checkpoint_state((struct simulation *)arg, checkpoint_file, false);
+}
+
+// Fast-forward core up to instruction until of its trace. Returns false if
+// the trace ends first.
+static bool fast_forward(struct simulation *sim, int core,
+                         struct frontend_cursor *cur, uint64_t until) {
+  uint64_t *clock = &sim->clocks[core];
+  while (*clock < until) {
+    uint64_t left = until - *clock;
+    if (!sim->run(sim->c, sim->set_locks, sim->num_threads, core, cur,
+                  left < INT_MAX ? left : INT_MAX, clock, false))
+      return false;
+  }
+  return true;
+}
+
+// Run up to max detailed instructions of core, or all of them if max is 0.
+// A sampled core stops early at the end of its window and fast-forwards to
+// the next one. Returns false once the trace is exhausted.
+static bool run_quantum(struct simulation *sim, int core,
+                        struct frontend_cursor *cur, int max) {
+  uint64_t *clock = &sim->clocks[core];
+  if (!sample_detail || *clock < warmup)
+    return sim->run(sim->c, sim->set_locks, sim->num_threads, core, cur, max,
+                    clock, true);
+  do {
+    uint64_t period = sample_detail + sample_gap;
+    uint64_t phase = (*clock - warmup) % period;
+    if (phase >= sample_detail) {
+      // restored inside a gap: skip to the next window
+      if (!fast_forward(sim, core, cur, *clock + period - phase))
+        return false;
+      phase = 0;
+    }
+    if (!phase)
+      stats_sample_begin(core);
+    uint64_t left = sample_detail - phase;
+    if (max && (uint64_t)max < left)
+      left = max;
+    int n = left < INT_MAX ? left : INT_MAX;
+    if (!sim->run(sim->c, sim->set_locks, sim->num_threads, core, cur, n,
+                  clock, true))
+      return false;
+    if (phase + n == sample_detail) {
+      stats_sample_end(core);
+      if (!fast_forward(sim, core, cur, *clock + sample_gap))
+        return false;
+    }
+  } while (!max);
+  return true;
+}
+
+// engine_step running the next sync_quantum instructions of core.
+static bool step_core(int core, void *arg) {
+  struct simulation *sim = (struct simulation *)arg;
+  if (run_quantum(sim, core, &sim->cursors[core], sync_quantum))
+    return true;
+  output_core_done(core);
+  return false;
+}
+
+// Run every core on its own OpenMP thread.
+static void run_per_thread(struct simulation *sim) {
+  // Cores that still had instructions left at the end of each sync round.
+  // Round r counts into live[r % 3]. Core 0 clears the slot for round r + 1
+  // during round r; its last readers finished with it in round r - 2.
+  int live[3] = {0};
+
+#pragma omp parallel num_threads(sim->num_threads)
+  {
+
+    // processor num
+    int core = omp_get_thread_num();
+
+    struct frontend_cursor cur = {NULL, NULL};
+    bool done = !fast_forward(sim, core, &cur, warmup);
+
+    for (int round = 0;; round++) {
+      debug_core(core, "\nClock tick\n");
+
+      // Decode instructions and execute them, sync_quantum of them per round
+      // or the whole trace in relaxed mode.
+      if (!done)
+        done = !run_quantum(sim, core, &cur, sync_quantum);
+
+      if (!sync_quantum)
+        break;
+
+      // synchronize clock tick, until every core has run out of instructions
+      if (!done) {
+#pragma omp atomic
+        live[round % 3]++;
+      }
+      if (core == 0)
+        live[(round + 1) % 3] = 0;
+#pragma omp barrier
+      if (!live[round % 3])
+        break;
+      if (checkpoint_due(round)) {
+#pragma omp single
+        checkpoint_state(sim, checkpoint_file, false);
+      }
+    }
+    output_core_done(core);
   }
 }
 
+// Run the cores as tasks of the engine's worker pool.
+static void run_on_workers(struct simulation *sim) {
+  sim->cursors = (struct frontend_cursor *)calloc(
+      sim->num_threads, sizeof(struct frontend_cursor));
+  // The pool fast-forwards the cores before the first epoch, without epochs
+  // of its own.
+  if (warmup) {
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_workers)
+    for (int core = 0; core < sim->num_threads; core++)
+      fast_forward(sim, core, &sim->cursors[core], warmup);
+  }
+  engine_run(sim->num_threads, num_workers, step_core, epoch_done, sim);
+  free(sim->cursors);
+}
+
+// Carve the private state of core from a: its caches and its statistics.
+static void layout_core(struct arena *a, int core, core_cache *cc,
+                        core_stats **st) {
+  size_t lines = (size_t)geo.sets * geo.ways;
+  *st = (core_stats *)arena_alloc(a, sizeof(core_stats));
+  cc->tags = (uint64_t *)arena_alloc(a, sizeof(uint64_t) * lines);
+  cc->states = (uint8_t *)arena_alloc(a, lines + TAG_MATCH_PAD);
+  cc->data = (byte *)arena_alloc(a, lines * geo.line_size);
+  repl_init(&cc->repl, a, repl_policy, geo.sets, geo.ways, core + 1);
+  if (l2_sets)
+    tag_cache_init(&cc->l2, a, l2_sets, l2_ways, repl_policy, core + 1);
+  if (prefetching) {
+    cc->prefetched = (uint8_t *)arena_alloc(a, lines);
+    cc->pf = (struct prefetch_state *)arena_alloc(
+        a, sizeof(struct prefetch_state));
+  }
+  if (store_buffer_size)
+    store_buffer_init(&cc->sb, a, store_buffer_size, geo.line_size);
+  if (hotspot_lines)
+    cc->hot = (struct hotspot_table *)arena_alloc(
+        a, sizeof(struct hotspot_table));
+}
+
 // This function implements the mock CPU loop that reads and writes data.
-void cpu_loop(int num_threads) {
-  int cache_size = 2;
+void cpu_loop(int num_threads, char **trace_files) {
+  geo.pow2 = is_pow2(geo.sets) && is_pow2(geo.line_size);
+  if (geo.pow2) {
+    geo.offset_bits = __builtin_ctz(geo.line_size);
+  }
+  run_kernel run = select_kernel();
+  transitions = coherence_table[protocol];
 
-  // initialize the cache of all the cores
-  cache **c = (cache **)malloc(sizeof(cache *) * num_threads);
-  for (int i = 0; i < num_threads; i++) {
-    *(c + i) = (cache *)malloc(sizeof(cache) * cache_size);
+  // one lock per stripe of sets
+  if (lock_stripes <= 0 || lock_stripes > geo.sets)
+    lock_stripes = geo.sets;
+  if (record_file)
+    replay_start(REPLAY_RECORD, lock_stripes, num_threads, NULL);
+  else if (replay_file &&
+           !replay_start(REPLAY_REPLAY, lock_stripes, num_threads,
+                         replay_file))
+    exit(1);
+
+  // All caches, locks and statistics live in one arena: the shared state,
+  // then a page-aligned block per core. Every core has the same layout, so
+  // sizing one block sizes them all.
+  struct arena sizing = {0};
+  core_cache probe;
+  core_stats *probe_stats;
+  layout_core(&sizing, 0, &probe, &probe_stats);
+  size_t block = arena_page_round(sizing.used);
+
+  struct arena arena = {0};
+  core_cache *c;
+  core_stats **per_core;
+  omp_lock_t *set_locks;
+  char *blocks;
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass)
+      arena_map(&arena);
+    c = (core_cache *)arena_alloc(&arena, sizeof(core_cache) * num_threads);
+    per_core =
+        (core_stats **)arena_alloc(&arena, sizeof(core_stats *) * num_threads);
+    set_locks =
+        (omp_lock_t *)arena_alloc(&arena, sizeof(omp_lock_t) * lock_stripes);
+    if (llc_sets)
+      llc_init(&llc, &arena, llc_sets, llc_ways, llc_banks, llc_inclusion,
+               repl_policy);
+    blocks = (char *)arena_alloc_aligned(&arena, block * num_threads,
+                                         ARENA_PAGE);
+  }
+  for (int i = 0; i < lock_stripes; i++) {
+    omp_init_lock(&set_locks[i]);
+  }
+
+  // Each block is laid out, and so first touched, by the host thread that
+  // will run the core, which keeps the core's state on that thread's node.
+  int hosts = num_workers > 0 && num_workers < num_threads ? num_workers
+                                                           : num_threads;
+#pragma omp parallel num_threads(hosts)
+  for (int i = omp_get_thread_num(); i < num_threads; i += hosts) {
+    struct arena own = {blocks + block * i, block, 0};
+    layout_core(&own, i, &c[i], &per_core[i]);
+    c[i].socket = numa_socket(i, num_threads);
   }
 
   // Initial cache state
@@ -110,154 +1479,416 @@ void cpu_loop(int num_threads) {
   debug("Initial Cache State\n");
   for (int i = 0; i < num_threads; i++) {
     debug("\tCore %d\n", i);
-    print_cachelines(*(c + i), cache_size);
+    print_cachelines(&c[i]);
     debug("\n");
   }
   #endif
 
-#pragma omp parallel num_threads(num_threads)
-  {
+  if (use_directory) {
+    dir_words = (num_threads + 63) / 64;
+    // round entries up to a power of two so they never straddle pages
+    while (dir_words & (dir_words - 1))
+      dir_words++;
+    sparse_init(&directory, dir_words * sizeof(uint64_t));
+  }
 
-    // processor num
-    int core = omp_get_thread_num();
+  stats_init(num_threads, per_core);
+  if (sample_detail)
+    stats_sample_init(num_threads);
 
-    // Input file for the core
-    char filename[20];
-    sprintf(filename, "input_%d.txt", core);
-    printf("Reading from file: %s\n", filename);
+  struct simulation sim = {
+      c, set_locks, num_threads, run,
+      (uint64_t *)calloc(num_threads, sizeof(uint64_t)), NULL};
+  if (restore_file && !checkpoint_state(&sim, restore_file, true))
+    exit(1);
 
-    // Read Input file
-    FILE *inst_file = fopen(filename, "r");
-    char inst_line[20];
+  // Announce the traces before the writer thread starts so that these lines
+  // come first in every output mode.
+  for (int core = 0; core < num_threads; core++)
+    printf("Reading from file: %s\n", trace_files[core]);
+  trace **traces = (trace **)malloc(sizeof(trace *) * num_threads);
+  for (int core = 0; core < num_threads; core++)
+    traces[core] = trace_open(trace_files[core], use_mmap);
+  // A restored core continues after the instructions it had already run.
+  for (int core = 0; core < num_threads; core++) {
+    if (traces[core] && sim.clocks[core] &&
+        trace_skip(traces[core], sim.clocks[core]) < sim.clocks[core])
+      fprintf(stderr, "%s: shorter than the checkpoint\n",
+              trace_files[core]);
+  }
+  frontend_start(num_threads, traces, num_decoders);
+  output_start(num_threads, stdout);
 
-    // Decode instructions and execute them.
-    while (fgets(inst_line, sizeof(inst_line), inst_file)) {
-#pragma omp single
-      debug("\nClock tick\n");
+  if (num_workers > 0)
+    run_on_workers(&sim);
+  else
+    run_per_thread(&sim);
+  output_finish();
+  if (checkpoint_file)
+    checkpoint_state(&sim, checkpoint_file, false);
+  if (replay_mode != REPLAY_OFF)
+    replay_finish(record_file);
+  if (sample_detail) {
+    // Estimate over the instructions after the warmup.
+    for (int core = 0; core < num_threads; core++)
+      sim.clocks[core] = sim.clocks[core] > warmup ? sim.clocks[core] - warmup
+                                                   : 0;
+    stats_sample_finish(sim.clocks);
+  }
+  free(sim.clocks);
+  frontend_finish();
+  for (int core = 0; core < num_threads; core++) {
+    if (traces[core])
+      trace_close(traces[core]);
+  }
+  free(traces);
 
-#ifdef DEBUG
-#  pragma omp critical(test)
-      {
-#endif
+  if (output_mode == OUTPUT_QUIET) {
+    stats_print(stdout);
+    if (numa_sockets > 1)
+      numa_report(stdout, num_threads, geo.line_size);
+  }
+  if (stats_file)
+    stats_export(stats_file);
+  if (hotspot_lines) {
+    struct hotspot_table **tables = (struct hotspot_table **)malloc(
+        sizeof(struct hotspot_table *) * num_threads);
+    for (int core = 0; core < num_threads; core++)
+      tables[core] = c[core].hot;
+    hotspot_report(stdout, tables, num_threads, geo.line_size);
+    free(tables);
+  }
 
-        decoded inst = decode_inst_line(inst_line);
-
-        // direct mapping hash
-        int hash = inst.address % cache_size;
-
-        // make memory access atomic
-        // replace the cacheline if the address is different and data is
-        // modified
-        if (c[core][hash].address != inst.address &&
-            (c[core][hash].state == Modified ||
-             c[core][hash].state == Shared)) {
-          // Flush current cacheline to memory
-          debug("Flushing cacheline at address %d to memory\n",
-                c[core][hash].address);
-          // prevent concurrent access to memory
-#pragma omp critical(mem_access)
-          {
-            memory[c[core][hash].address] = c[core][hash].value;
-            c[core][hash].value = memory[inst.address];
-          }
-          c[core][hash].address = inst.address;
-        }
-        if (inst.type == 1) /* Write operation */ {
-          c[core][hash].address = inst.address;
-          c[core][hash].value = inst.value;
-          c[core][hash].state = Modified;
-
-          // invalidate other caches if data is not exclusive
-          if (c[core][hash].state != Exclusive) {
-
-            // iterate and invalidate other caches
-#pragma omp critical(cache_access)
-            {
-              for (int i = 0; i < num_threads; i++) {
-                if (i == core)
-                  continue;
-                if (c[i][hash].address == inst.address) {
-                  debug("Core %d: Invalidating address %d\n", i, inst.address);
-                  c[i][hash].state = Invalid;
-                }
-              }
-            }
-          }
-
-          // set the state to modified
-
-        } else /* Read Operation*/ {
-          if (c[core][hash].address != inst.address ||
-              c[core][hash].state == Invalid) /* read miss */ {
-            debug("Read Miss\n");
-            bool found = false;
-#pragma omp critical(cache_access)
-            {
-              for (int i = 0; i < num_threads; i++) {
-                if (i == core || c[i][hash].address != inst.address ||
-                    c[i][hash].state == Invalid)
-                  continue;
-                // data found in other cache
-                c[core][hash] = c[i][hash];
-                c[i][hash].state = Shared;
-                c[core][hash].state = Shared;
-                found = true;
-              }
-            }
-            if (!found) {
-// fetch data from mem
-#pragma omp critical(mem_access)
-              {
-                c[core][hash].value = memory[inst.address];
-                c[core][hash].state = Exclusive;
-                c[core][hash].address = inst.address;
-              }
-            }
-          }
-        }
-#pragma omp critical(print)
-        {
-          switch (inst.type) {
-          case 0:
-            printf("Core %d Reading from address %02d: %02d\n", core,
-                   c[core][hash].address, c[core][hash].value);
-            break;
-
-          case 1:
-            printf("Core %d Writing   to address %02d: %02d\n", core,
-                   c[core][hash].address, c[core][hash].value);
-            break;
-          }
-#ifdef DEBUG
-          debug("Memory: ");
-          for (int i = 0; i < 24; i++) {
-            debug("%02d:%02d ", i, memory[i]);
-          }
-          debug("\n");
-          for (int i = 0; i < num_threads; i++) {
-            debug("\tCore %d\n", i);
-            print_cachelines(*(c + i), cache_size);
-            debug("\n");
-          }
-#endif
-        }
+  for (int i = 0; i < lock_stripes; i++) {
+    omp_destroy_lock(&set_locks[i]);
+  }
+  if (llc_sets)
+    llc_destroy(&llc);
+  if (use_directory)
+    sparse_free(&directory);
+  arena_unmap(&arena);
+}
 
-        // synchronize clock tick
-#ifdef DEBUG
-      }
-#endif
+// Long names of the options, which are also the keys of configuration files.
+static const struct option long_options[] = {
+    {"stdio", no_argument, NULL, 's'},
+    {"directory", no_argument, NULL, 'd'},
+    {"protocol", required_argument, NULL, 'p'},
+    {"quantum", required_argument, NULL, 'q'},
+    {"locks", required_argument, NULL, 'l'},
+    {"workers", required_argument, NULL, 'w'},
+    {"decoders", required_argument, NULL, 'F'},
+    {"cores", required_argument, NULL, 'n'},
+    {"traces", required_argument, NULL, 't'},
+    {"config", required_argument, NULL, 'c'},
+    {"sets", required_argument, NULL, 'S'},
+    {"ways", required_argument, NULL, 'A'},
+    {"line", required_argument, NULL, 'B'},
+    {"l2", required_argument, NULL, '2'},
+    {"llc", required_argument, NULL, '3'},
+    {"inclusion", required_argument, NULL, 'I'},
+    {"latency", required_argument, NULL, 'L'},
+    {"prefetch", required_argument, NULL, 'f'},
+    {"store-buffer", required_argument, NULL, 'b'},
+    {"consistency", required_argument, NULL, 'm'},
+    {"replacement", required_argument, NULL, 'r'},
+    {"output", required_argument, NULL, 'o'},
+    {"stats", required_argument, NULL, 'x'},
+    {"hotspots", required_argument, NULL, 'H'},
+    {"sockets", required_argument, NULL, 'N'},
+    {"checkpoint", required_argument, NULL, 'C'},
+    {"checkpoint-every", required_argument, NULL, 'K'},
+    {"restore", required_argument, NULL, 'R'},
+    {"record", required_argument, NULL, 'Y'},
+    {"replay", required_argument, NULL, 'Z'},
+    {"warmup", required_argument, NULL, 'W'},
+    {"sample", required_argument, NULL, 'P'},
+    {NULL, 0, NULL, 0},
+};
 
-#pragma omp barrier
+// Core count and where the traces come from: explicit paths, or the pattern
+// with %d replaced by each core's number.
+static int num_cores;
+static const char *trace_pattern = "input_%d.txt";
+static char **config_traces;
+static int num_config_traces;
+
+static bool read_config(const char *path);
+
+// Whether a flag option's value is on. Flags given without a value are.
+static bool parse_flag(const char *arg, bool *on) {
+  if (!arg || !strcmp(arg, "1") || !strcmp(arg, "true") ||
+      !strcmp(arg, "yes"))
+    *on = true;
+  else if (!strcmp(arg, "0") || !strcmp(arg, "false") || !strcmp(arg, "no"))
+    *on = false;
+  else
+    return false;
+  return true;
+}
+
+// Apply option opt with argument arg, from the command line or a
+// configuration file. Returns false if arg is invalid. arg must stay valid
+// for the rest of the run.
+static bool set_option(int opt, char *arg) {
+  bool on;
+  switch (opt) {
+  case 's':
+    if (!parse_flag(arg, &on))
+      return false;
+    use_mmap = !on;
+    return true;
+  case 'd':
+    return parse_flag(arg, &use_directory);
+  case 'p': {
+    int p = protocol_parse(arg);
+    if (p < 0)
+      return false;
+    protocol = p;
+    return true;
+  }
+  case 'l':
+    lock_stripes = atoi(arg);
+    return true;
+  case 'w':
+    num_workers = atoi(arg);
+    return true;
+  case 'F':
+    num_decoders = atoi(arg);
+    return num_decoders >= 0;
+  case 'n':
+    num_cores = atoi(arg);
+    return num_cores > 0;
+  case 't':
+    trace_pattern = arg;
+    return strstr(arg, "%d");
+  case 'c':
+    return read_config(arg);
+  case 'S':
+    geo.sets = atoi(arg);
+    return geo.sets > 0;
+  case 'A':
+    geo.ways = atoi(arg);
+    return geo.ways > 0;
+  case 'B':
+    geo.line_size = atoi(arg);
+    return geo.line_size > 0;
+  case '2':
+    return sscanf(arg, "%d:%d", &l2_sets, &l2_ways) == 2 && l2_sets > 0 &&
+           l2_ways > 0;
+  case '3':
+    return sscanf(arg, "%d:%d:%d", &llc_sets, &llc_ways, &llc_banks) >= 2 &&
+           llc_sets > 0 && llc_ways > 0 && llc_banks > 0;
+  case 'I': {
+    int inclusion = inclusion_parse(arg);
+    if (inclusion < 0)
+      return false;
+    llc_inclusion = inclusion;
+    return true;
+  }
+  case 'L':
+    return parse_latencies(arg);
+  case 'f':
+    return prefetch_parse(arg);
+  case 'b':
+    store_buffer_size = atoi(arg);
+    return store_buffer_size >= 0;
+  case 'm': {
+    int model = 0;
+    while (model < CONSISTENCIES && strcmp(arg, consistency_names[model]))
+      model++;
+    if (model == CONSISTENCIES)
+      return false;
+    consistency = model;
+    return true;
+  }
+  case 'r': {
+    int policy = repl_parse(arg);
+    if (policy < 0)
+      return false;
+    repl_policy = policy;
+    return true;
+  }
+  case 'o':
+    if (!strcmp(arg, "async"))
+      output_mode = OUTPUT_ASYNC;
+    else if (!strcmp(arg, "ordered"))
+      output_mode = OUTPUT_ORDERED;
+    else if (!strcmp(arg, "quiet"))
+      output_mode = OUTPUT_QUIET;
+    else
+      return false;
+    return true;
+  case 'x':
+    stats_file = arg;
+    return true;
+  case 'C':
+    checkpoint_file = arg;
+    return true;
+  case 'K':
+    checkpoint_every = strtoull(arg, NULL, 0);
+    return checkpoint_every > 0;
+  case 'R':
+    restore_file = arg;
+    return true;
+  case 'Y':
+    record_file = arg;
+    return true;
+  case 'Z':
+    replay_file = arg;
+    return true;
+  case 'W':
+    warmup = strtoull(arg, NULL, 0);
+    return true;
+  case 'H':
+    hotspot_lines = atoi(arg);
+    return hotspot_lines >= 0;
+  case 'N':
+    return numa_parse(arg);
+  case 'P':
+    return sscanf(arg, "%" SCNu64 ":%" SCNu64, &sample_detail,
+                  &sample_gap) == 2 &&
+           sample_detail > 0;
+  case 'q':
+    sync_quantum = atoi(arg);
+    return sync_quantum >= 0;
+  default:
+    return false;
+  }
+}
+
+static char *trim(char *p) {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  char *end = p + strlen(p);
+  while (end > p && strchr(" \t\r\n", end[-1]))
+    end--;
+  *end = '\0';
+  return p;
+}
+
+// Apply a configuration file: one "name = value" per line, named like the
+// long options, or just "name" for flags. "trace = path" adds a trace file.
+// Blank lines and lines starting with # are skipped.
+static bool read_config(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char buf[4096];
+  bool ok = true;
+  for (int n = 1; ok && fgets(buf, sizeof(buf), f); n++) {
+    char *key = trim(buf), *value = strchr(key, '=');
+    if (!*key || *key == '#')
+      continue;
+    if (value) {
+      *value = '\0';
+      value = strdup(trim(value + 1));
+      key = trim(key);
+    }
+    const struct option *o = long_options;
+    while (o->name && strcmp(o->name, key))
+      o++;
+    if (!strcmp(key, "trace") && value) {
+      config_traces = (char **)realloc(
+          config_traces, sizeof(char *) * (num_config_traces + 1));
+      config_traces[num_config_traces++] = value;
+    } else if (!o->name || (o->has_arg == required_argument && !value) ||
+               !set_option(o->val, value)) {
+      fprintf(stderr, "%s:%d: bad setting %s\n", path, n, key);
+      ok = false;
     }
-    free(c);
   }
+  fclose(f);
+  return ok;
+}
+
+// trace_pattern with its %d replaced by core.
+static char *trace_name(int core) {
+  const char *d = strstr(trace_pattern, "%d");
+  size_t len = strlen(trace_pattern) + 16;
+  char *name = (char *)malloc(len);
+  snprintf(name, len, "%.*s%d%s", (int)(d - trace_pattern), trace_pattern,
+           core, d + 2);
+  return name;
 }
 
-int main(int c, char *argv[]) {
+int main(int argc, char *argv[]) {
+  const char *short_options =
+      "sdp:q:l:w:F:n:t:c:S:A:B:2:3:I:L:f:b:m:r:o:x:H:N:C:K:R:Y:Z:W:P:";
+  int opt;
+  while ((opt = getopt_long(argc, argv, short_options, long_options,
+                            NULL)) != -1) {
+    if (!set_option(opt, optarg)) {
+      fprintf(stderr,
+              "usage: %s [-s] [-d] [-p protocol] [-q quantum] [-l locks] "
+              "[-w workers] [-F decoders] [-n cores] [-t pattern] "
+              "[-c config] [-S sets] [-A ways] [-B bytes] [-2 S:A] "
+              "[-3 S:A[:N]] [-I inclusion] [-L lat=N,...] [-f pf[:N],...] "
+              "[-b entries] [-m model] [-r policy] [-o mode] [-x file] "
+              "[-H lines] [-N S[:B]] [-C file] [-K insts] [-R file] "
+              "[-Y file] [-Z file] [-W insts] [-P D:G] [trace ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  const char *bad = repl_check(repl_policy, geo.ways);
+  if (!bad && l2_sets)
+    bad = repl_check(repl_policy, l2_ways);
+  if (!bad && llc_sets)
+    bad = repl_check(repl_policy, llc_ways);
+  if (l2_sets % geo.sets)
+    bad = "L2 sets must be a multiple of the L1 sets";
+  if (llc_sets % geo.sets)
+    bad = "LLC sets must be a multiple of the L1 sets";
+  if (llc_sets % llc_banks)
+    bad = "LLC sets must be a multiple of its banks";
+  if (checkpoint_every && !sync_quantum)
+    bad = "periodic checkpoints need a sync quantum (-q)";
+  if (replay_file && num_workers > 0)
+    bad = "replaying needs one host thread per core";
+  if (replay_file && record_file)
+    bad = "can't record and replay at once";
+#ifdef DEBUG
+  // Cores waiting for their turn would hold the DEBUG critical section.
+  if (replay_file)
+    bad = "DEBUG builds can't replay";
+#endif
+
+  // Traces on the command line replace those of configuration files, and
+  // either replaces the pattern.
+  char **trace_files = config_traces;
+  int num_traces = num_config_traces;
+  if (optind < argc) {
+    trace_files = argv + optind;
+    num_traces = argc - optind;
+  }
+  if (!num_cores)
+    num_cores = num_traces ? num_traces : 2;
+  if (num_traces && num_traces != num_cores)
+    bad = "need one trace per core";
+  // A worker runs a core's whole quantum before it takes another core, and
+  // the ordered writer can't let the core get further ahead than its ring.
+  if (output_mode == OUTPUT_ORDERED && num_workers > 0 &&
+      num_workers < num_cores &&
+      (!sync_quantum || sync_quantum >= OUTPUT_RING_SIZE))
+    bad = "ordered output on fewer workers than cores needs a quantum "
+          "below the output ring size";
+  if (bad) {
+    fprintf(stderr, "%s: %s\n", argv[0], bad);
+    return 1;
+  }
+  if (!num_traces) {
+    trace_files = (char **)malloc(sizeof(char *) * num_cores);
+    for (int core = 0; core < num_cores; core++)
+      trace_files[core] = trace_name(core);
+  }
+
   // Initialize Global memory
-  // Let's assume the memory module holds about 24 bytes of data.
-  int memory_size = 24;
-  memory = (byte *)malloc(sizeof(byte) * memory_size);
-  cpu_loop(2);
-  free(memory);
+  // Memory spans the whole 64-bit address space; pages are only allocated
+  // once something is written back to them.
+  mem_init();
+  cpu_loop(num_cores, trace_files);
+  mem_free();
 }
@@ -0,0 +1,79 @@
+/*
+ * Filename: checkpoint.c
+ * Checkpoint file I/O, see checkpoint.h.
+ */
+#include "checkpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool ckpt_open(struct checkpoint *ck, const char *path, bool restore) {
+  ck->restore = restore;
+  ck->ok = true;
+  ck->path = path;
+  ck->tmp_path = NULL;
+  if (restore) {
+    ck->file = fopen(path, "rb");
+  } else {
+    size_t len = strlen(path) + sizeof(".tmp");
+    ck->tmp_path = (char *)malloc(len);
+    snprintf(ck->tmp_path, len, "%s.tmp", path);
+    ck->file = fopen(ck->tmp_path, "wb");
+  }
+  if (!ck->file) {
+    perror(restore ? path : ck->tmp_path);
+    free(ck->tmp_path);
+    return false;
+  }
+
+  char magic[4];
+  memcpy(magic, CKPT_MAGIC, sizeof(magic));
+  ckpt_bytes(ck, magic, sizeof(magic));
+  if (ck->ok && memcmp(magic, CKPT_MAGIC, sizeof(magic))) {
+    fprintf(stderr, "%s: not a checkpoint\n", path);
+    ck->ok = false;
+  }
+  ckpt_match(ck, CKPT_VERSION, "version");
+  if (!ck->ok) {
+    ckpt_close(ck);
+    return false;
+  }
+  return true;
+}
+
+void ckpt_bytes(struct checkpoint *ck, void *p, size_t len) {
+  if (!ck->ok)
+    return;
+  size_t done = ck->restore ? fread(p, 1, len, ck->file)
+                            : fwrite(p, 1, len, ck->file);
+  if (done != len) {
+    fprintf(stderr, "%s: %s\n", ck->restore ? ck->path : ck->tmp_path,
+            ck->restore ? "truncated checkpoint" : "write failed");
+    ck->ok = false;
+  }
+}
+
+void ckpt_match(struct checkpoint *ck, uint64_t value, const char *what) {
+  uint64_t saved = value;
+  ckpt_u64(ck, &saved);
+  if (ck->ok && saved != value) {
+    fprintf(stderr, "%s: checkpoint has %s %llu instead of %llu\n", ck->path,
+            what, (unsigned long long)saved, (unsigned long long)value);
+    ck->ok = false;
+  }
+}
+
+bool ckpt_close(struct checkpoint *ck) {
+  if (fclose(ck->file))
+    ck->ok = false;
+  if (!ck->restore) {
+    if (ck->ok && rename(ck->tmp_path, ck->path)) {
+      perror(ck->path);
+      ck->ok = false;
+    }
+    if (!ck->ok)
+      remove(ck->tmp_path);
+    free(ck->tmp_path);
+  }
+  return ck->ok;
+}
@@ -0,0 +1,53 @@
+/*
+ * Filename: checkpoint.h
+ * Checkpoint files of the complete simulator state.
+ *
+ * Saving and restoring walk the state with the same code: every piece of
+ * state is passed to ckpt_bytes(), which writes it to the file when saving
+ * and reads it back in place when restoring. The walk starts with the
+ * configuration, which a restore checks against the running one, so a
+ * checkpoint only restores into a simulator laid out exactly like the one
+ * that took it.
+ *
+ * A checkpoint is written to a temporary file that replaces the previous
+ * checkpoint only once it is complete, so a crash while saving leaves the
+ * last good checkpoint in place.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CKPT_MAGIC "CSCK"
+#define CKPT_VERSION 7
+
+struct checkpoint {
+  FILE *file;
+  bool restore; // reading a checkpoint rather than writing one
+  bool ok;      // no I/O error or mismatch so far
+  const char *path;
+  char *tmp_path; // while saving
+};
+
+// Start saving to path, or restoring from it. Returns false (with a message
+// on stderr) if the file can't be opened or is not a checkpoint.
+bool ckpt_open(struct checkpoint *ck, const char *path, bool restore);
+
+// Write or read the len bytes at p.
+void ckpt_bytes(struct checkpoint *ck, void *p, size_t len);
+
+static inline void ckpt_u64(struct checkpoint *ck, uint64_t *v) {
+  ckpt_bytes(ck, v, sizeof(*v));
+}
+
+// Save value, or check that the checkpoint holds the same value for what.
+void ckpt_match(struct checkpoint *ck, uint64_t value, const char *what);
+
+// Finish the checkpoint. A saved checkpoint replaces the file at path.
+// Returns whether everything was saved or restored.
+bool ckpt_close(struct checkpoint *ck);
+
+#endif
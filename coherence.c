@@ -0,0 +1,96 @@
+/*
+ * Filename: coherence.c
+ * Transition tables of the protocols in coherence.h.
+ */
+#include "coherence.h"
+
+#include <string.h>
+
+#define T(state, actions)                                                      \
+  { state, actions }
+
+// Transitions every protocol shares, apart from the state a read miss on a
+// shared line fills in. States a protocol doesn't have are never reached and
+// keep all-Invalid rows.
+#define COMMON_ROWS(shared_fill)                                               \
+  [Invalid] = {[EV_READ] = T(Invalid, ACT_FETCH),                              \
+               [EV_WRITE] = T(Modified, ACT_FETCH | ACT_INVALIDATE),           \
+               [EV_FILL] = T(Exclusive, 0),                                    \
+               [EV_FILL_SHARED] = T(shared_fill, 0)},                          \
+  [Exclusive] = {[EV_READ] = T(Exclusive, 0),                                  \
+                 [EV_WRITE] = T(Modified, 0),                                  \
+                 [EV_SNOOP_READ] = T(Shared, ACT_SUPPLY),                      \
+                 [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),                    \
+                 [EV_EVICT] = T(Invalid, 0)}
+
+const struct transition coherence_table[PROTOCOLS][STATES][EVENTS] = {
+    [PROTO_MESI] =
+        {
+            COMMON_ROWS(Shared),
+            [Shared] = {[EV_READ] = T(Shared, 0),
+                        [EV_WRITE] = T(Modified, ACT_INVALIDATE),
+                        [EV_SNOOP_READ] = T(Shared, ACT_SUPPLY),
+                        [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                        [EV_EVICT] = T(Invalid, 0)},
+            [Modified] = {[EV_READ] = T(Modified, 0),
+                          [EV_WRITE] = T(Modified, 0),
+                          [EV_SNOOP_READ] =
+                              T(Shared, ACT_SUPPLY | ACT_WRITEBACK),
+                          [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                          [EV_EVICT] = T(Invalid, ACT_WRITEBACK)},
+        },
+    [PROTO_MOESI] =
+        {
+            COMMON_ROWS(Shared),
+            [Shared] = {[EV_READ] = T(Shared, 0),
+                        [EV_WRITE] = T(Modified, ACT_INVALIDATE),
+                        [EV_SNOOP_READ] = T(Shared, 0),
+                        [EV_SNOOP_WRITE] = T(Invalid, 0),
+                        [EV_EVICT] = T(Invalid, 0)},
+            [Modified] = {[EV_READ] = T(Modified, 0),
+                          [EV_WRITE] = T(Modified, 0),
+                          [EV_SNOOP_READ] = T(Owned, ACT_SUPPLY),
+                          [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                          [EV_EVICT] = T(Invalid, ACT_WRITEBACK)},
+            [Owned] = {[EV_READ] = T(Owned, 0),
+                       [EV_WRITE] = T(Modified, ACT_INVALIDATE),
+                       [EV_SNOOP_READ] = T(Owned, ACT_SUPPLY),
+                       [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                       [EV_EVICT] = T(Invalid, ACT_WRITEBACK)},
+        },
+    [PROTO_MESIF] =
+        {
+            COMMON_ROWS(Forward),
+            [Shared] = {[EV_READ] = T(Shared, 0),
+                        [EV_WRITE] = T(Modified, ACT_INVALIDATE),
+                        [EV_SNOOP_READ] = T(Shared, 0),
+                        [EV_SNOOP_WRITE] = T(Invalid, 0),
+                        [EV_EVICT] = T(Invalid, 0)},
+            [Modified] = {[EV_READ] = T(Modified, 0),
+                          [EV_WRITE] = T(Modified, 0),
+                          [EV_SNOOP_READ] =
+                              T(Shared, ACT_SUPPLY | ACT_WRITEBACK),
+                          [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                          [EV_EVICT] = T(Invalid, ACT_WRITEBACK)},
+            [Forward] = {[EV_READ] = T(Forward, 0),
+                         [EV_WRITE] = T(Modified, ACT_INVALIDATE),
+                         [EV_SNOOP_READ] = T(Shared, ACT_SUPPLY),
+                         [EV_SNOOP_WRITE] = T(Invalid, ACT_SUPPLY),
+                         [EV_EVICT] = T(Invalid, 0)},
+        },
+};
+
+const char *const protocol_names[PROTOCOLS] = {
+    [PROTO_MESI] = "mesi", [PROTO_MOESI] = "moesi", [PROTO_MESIF] = "mesif"};
+
+const char *const state_names[STATES] = {
+    [Invalid] = "Invalid",   [Shared] = "Shared", [Exclusive] = "Exclusive",
+    [Modified] = "Modified", [Owned] = "Owned",   [Forward] = "Forward"};
+
+int protocol_parse(const char *name) {
+  for (int p = 0; p < PROTOCOLS; p++) {
+    if (!strcmp(name, protocol_names[p]))
+      return p;
+  }
+  return -1;
+}
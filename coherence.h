@@ -0,0 +1,70 @@
+/*
+ * Filename: coherence.h
+ * Coherence protocols as state transition tables.
+ *
+ * A protocol maps the state of a line and an event seen by the cache holding
+ * it to the next state and the actions the simulator has to carry out. The
+ * requesting cache looks up EV_READ or EV_WRITE; if that asks for
+ * ACT_FETCH or ACT_INVALIDATE, every other copy of the line sees
+ * EV_SNOOP_READ or EV_SNOOP_WRITE, and a line filled by a read takes its
+ * state from EV_FILL or EV_FILL_SHARED, depending on whether any other cache
+ * held it. Replaced lines see EV_EVICT.
+ *
+ * - MESI writes Modified data back to memory when another core reads it, so
+ *   Shared lines are always clean and any of them may supply the line.
+ * - MOESI keeps the dirty line in the Owned state instead, which supplies it
+ *   to readers and is written back only when it is evicted.
+ * - MESIF designates the newest reader of a shared line as the Forward copy,
+ *   the only clean copy that answers reads; the other Shared copies stay
+ *   silent.
+ */
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdint.h>
+
+// Invalid must stay 0, see tag_match.h.
+enum mesi_state {
+  Invalid,
+  Shared,
+  Exclusive,
+  Modified,
+  Owned,
+  Forward,
+  STATES
+};
+
+typedef enum mesi_state mesi_state;
+
+enum coherence_protocol { PROTO_MESI, PROTO_MOESI, PROTO_MESIF, PROTOCOLS };
+
+enum coherence_event {
+  EV_READ,        // this core reads the line
+  EV_WRITE,       // this core writes the line
+  EV_FILL,        // a read miss found no other copy
+  EV_FILL_SHARED, // a read miss found other copies
+  EV_SNOOP_READ,  // another core misses on the line
+  EV_SNOOP_WRITE, // another core writes the line
+  EV_EVICT,       // the line is replaced
+  EVENTS
+};
+
+// Actions of a transition.
+#define ACT_FETCH 1      // the requester needs the data of the line
+#define ACT_INVALIDATE 2 // the requester must invalidate every other copy
+#define ACT_SUPPLY 4     // this copy sends its data to the requester
+#define ACT_WRITEBACK 8  // this copy is written back to memory
+
+struct transition {
+  uint8_t next; // mesi_state
+  uint8_t actions;
+};
+
+extern const struct transition coherence_table[PROTOCOLS][STATES][EVENTS];
+extern const char *const protocol_names[PROTOCOLS];
+extern const char *const state_names[STATES];
+
+// Protocol called name, or -1.
+int protocol_parse(const char *name);
+
+#endif
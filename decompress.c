@@ -0,0 +1,282 @@
+/*
+ * Filename: decompress.c
+ * Background zstd and LZ4 decompression, see decompress.h.
+ */
+#include "decompress.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef TRACE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef TRACE_LZ4
+#include <lz4frame.h>
+#endif
+
+// Compressed bytes read from the file at a time.
+#define DECOMP_INPUT (1 << 18)
+
+const char *const compression_names[COMPRESSIONS] = {
+    [COMP_NONE] = "uncompressed",
+    [COMP_ZSTD] = "zstd",
+    [COMP_LZ4] = "lz4",
+};
+
+// Frame magic numbers, as they appear in the file.
+static const uint8_t zstd_magic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+static const uint8_t lz4_magic[4] = {0x04, 0x22, 0x4d, 0x18};
+
+struct chunk {
+  char *buf; // DECOMP_KEEP bytes of room for kept bytes, then the data
+  size_t len;
+  bool full; // filled and not yet released by the reader
+};
+
+struct decompressor {
+  enum compression comp;
+  const char *filename;
+  FILE *file;
+  thrd_t thread;
+
+  // Reader and decompression thread only meet here.
+  mtx_t lock;
+  cnd_t changed;
+  struct chunk chunk[2];
+  bool done;    // no chunk will be filled after the full ones
+  bool closing; // the reader is gone
+
+  // Owned by the decompression thread.
+  char *in;
+  size_t in_pos, in_len;
+  bool in_eof;
+  size_t hint; // codec's last return, nonzero inside a frame
+#ifdef TRACE_ZSTD
+  ZSTD_DStream *zstd;
+#endif
+#ifdef TRACE_LZ4
+  LZ4F_dctx *lz4;
+#endif
+
+  // Owned by the reader: the chunk it walks, or -1 before the first one.
+  int cur;
+};
+
+enum compression compression_detect(const void *magic, size_t len) {
+  if (len < 4)
+    return COMP_NONE;
+  if (!memcmp(magic, zstd_magic, 4))
+    return COMP_ZSTD;
+  if (!memcmp(magic, lz4_magic, 4))
+    return COMP_LZ4;
+  return COMP_NONE;
+}
+
+static void refill_input(struct decompressor *d) {
+  d->in_pos = 0;
+  d->in_len = fread(d->in, 1, DECOMP_INPUT, d->file);
+  d->in_eof = d->in_len == 0;
+}
+
+// Decompress one step from the input into [dst + *pos, dst + cap). Returns
+// false on a corrupt stream.
+static bool decompress_step(struct decompressor *d, char *dst, size_t *pos,
+                            size_t cap) {
+  switch (d->comp) {
+#ifdef TRACE_ZSTD
+  case COMP_ZSTD: {
+    ZSTD_outBuffer out = {dst, cap, *pos};
+    ZSTD_inBuffer in = {d->in, d->in_len, d->in_pos};
+    size_t ret = ZSTD_decompressStream(d->zstd, &out, &in);
+    d->in_pos = in.pos;
+    *pos = out.pos;
+    d->hint = ret;
+    if (ZSTD_isError(ret)) {
+      fprintf(stderr, "%s: %s\n", d->filename, ZSTD_getErrorName(ret));
+      return false;
+    }
+    return true;
+  }
+#endif
+#ifdef TRACE_LZ4
+  case COMP_LZ4: {
+    size_t out_len = cap - *pos, in_len = d->in_len - d->in_pos;
+    size_t ret = LZ4F_decompress(d->lz4, dst + *pos, &out_len,
+                                 d->in + d->in_pos, &in_len, NULL);
+    d->in_pos += in_len;
+    *pos += out_len;
+    d->hint = ret;
+    if (LZ4F_isError(ret)) {
+      fprintf(stderr, "%s: %s\n", d->filename, LZ4F_getErrorName(ret));
+      return false;
+    }
+    return true;
+  }
+#endif
+  default:
+    // only reached without the codec, which codec_init() refuses
+    (void)dst;
+    (void)pos;
+    (void)cap;
+    return false;
+  }
+}
+
+// Fill [dst, dst + cap) completely unless the stream ends first. Returns the
+// number of bytes written.
+static size_t decompress_fill(struct decompressor *d, char *dst, size_t cap) {
+  size_t pos = 0;
+  while (pos < cap) {
+    if (d->in_pos == d->in_len && !d->in_eof)
+      refill_input(d);
+    size_t before = pos, consumed = d->in_pos, hint = d->hint;
+    if (!decompress_step(d, dst, &pos, cap))
+      break;
+    // With the input gone, the codec only has its buffered output left. It
+    // ended inside a frame if the last step that did anything expected more.
+    if (d->in_eof && pos == before && d->in_pos == consumed) {
+      if (hint)
+        fprintf(stderr, "%s: truncated %s stream\n", d->filename,
+                compression_names[d->comp]);
+      break;
+    }
+  }
+  return pos;
+}
+
+static int decompress_main(void *arg) {
+  struct decompressor *d = (struct decompressor *)arg;
+  for (int i = 0;; i ^= 1) {
+    struct chunk *c = &d->chunk[i];
+    mtx_lock(&d->lock);
+    while (c->full && !d->closing)
+      cnd_wait(&d->changed, &d->lock);
+    bool closing = d->closing;
+    mtx_unlock(&d->lock);
+    if (closing)
+      return 0;
+
+    size_t len = decompress_fill(d, c->buf + DECOMP_KEEP, DECOMP_CHUNK);
+    mtx_lock(&d->lock);
+    if (len) {
+      c->len = len;
+      c->full = true;
+    }
+    d->done = len < DECOMP_CHUNK;
+    cnd_broadcast(&d->changed);
+    mtx_unlock(&d->lock);
+    if (len < DECOMP_CHUNK)
+      return 0;
+  }
+}
+
+static bool codec_init(struct decompressor *d) {
+  switch (d->comp) {
+#ifdef TRACE_ZSTD
+  case COMP_ZSTD:
+    d->zstd = ZSTD_createDStream();
+    return d->zstd && !ZSTD_isError(ZSTD_initDStream(d->zstd));
+#endif
+#ifdef TRACE_LZ4
+  case COMP_LZ4:
+    return !LZ4F_isError(
+        LZ4F_createDecompressionContext(&d->lz4, LZ4F_VERSION));
+#endif
+  default:
+    fprintf(stderr, "%s: %s compressed trace, rebuild with %s=1\n",
+            d->filename, compression_names[d->comp],
+            d->comp == COMP_ZSTD ? "ZSTD" : "LZ4");
+    return false;
+  }
+}
+
+static void codec_free(struct decompressor *d) {
+  (void)d; // unused without any codec
+#ifdef TRACE_ZSTD
+  if (d->zstd)
+    ZSTD_freeDStream(d->zstd);
+#endif
+#ifdef TRACE_LZ4
+  if (d->lz4)
+    LZ4F_freeDecompressionContext(d->lz4);
+#endif
+}
+
+struct decompressor *decompressor_open(FILE *file, enum compression comp,
+                                       const char *filename,
+                                       const void *prefix, size_t prefix_len) {
+  struct decompressor *d =
+      (struct decompressor *)calloc(1, sizeof(struct decompressor));
+  d->comp = comp;
+  d->filename = filename;
+  d->file = file;
+  d->cur = -1;
+  if (!codec_init(d)) {
+    codec_free(d);
+    fclose(file);
+    free(d);
+    return NULL;
+  }
+  d->in = (char *)malloc(DECOMP_INPUT);
+  memcpy(d->in, prefix, prefix_len);
+  d->in_len = prefix_len;
+  for (int i = 0; i < 2; i++) {
+    // Keeps the data of each chunk 64-byte aligned.
+    d->chunk[i].buf = (char *)aligned_alloc(64, DECOMP_KEEP + DECOMP_CHUNK);
+  }
+  mtx_init(&d->lock, mtx_plain);
+  cnd_init(&d->changed);
+  thrd_create(&d->thread, decompress_main, d);
+  return d;
+}
+
+size_t decompressor_next(struct decompressor *d, const char **data,
+                         size_t keep) {
+  struct chunk *prev = d->cur >= 0 ? &d->chunk[d->cur] : NULL;
+  int i = d->cur >= 0 ? d->cur ^ 1 : 0;
+  struct chunk *c = &d->chunk[i];
+
+  mtx_lock(&d->lock);
+  while (!c->full && !d->done)
+    cnd_wait(&d->changed, &d->lock);
+  bool ready = c->full;
+  mtx_unlock(&d->lock);
+
+  const char *kept = prev ? prev->buf + DECOMP_KEEP + prev->len - keep : NULL;
+  if (!ready) {
+    *data = kept;
+    return prev ? keep : 0;
+  }
+
+  char *start = c->buf + DECOMP_KEEP - keep;
+  if (keep)
+    memcpy(start, kept, keep);
+  if (prev) {
+    mtx_lock(&d->lock);
+    prev->full = false;
+    cnd_broadcast(&d->changed);
+    mtx_unlock(&d->lock);
+  }
+  d->cur = i;
+  *data = start;
+  return c->len + keep;
+}
+
+void decompressor_close(struct decompressor *d) {
+  mtx_lock(&d->lock);
+  d->closing = true;
+  cnd_broadcast(&d->changed);
+  mtx_unlock(&d->lock);
+  thrd_join(d->thread, NULL);
+  mtx_destroy(&d->lock);
+  cnd_destroy(&d->changed);
+  codec_free(d);
+  fclose(d->file);
+  free(d->in);
+  for (int i = 0; i < 2; i++)
+    free(d->chunk[i].buf);
+  free(d);
+}
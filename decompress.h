@@ -0,0 +1,58 @@
+/*
+ * Filename: decompress.h
+ * Streaming decompression of zstd and LZ4 compressed traces.
+ *
+ * A decompressor reads the compressed file on a background thread and
+ * decompresses it into two chunks that it fills in turn, so the core reading
+ * the trace only ever waits for a chunk if decompression cannot keep up. The
+ * reader walks a chunk in place and hands it back when it asks for the next
+ * one.
+ *
+ * Every chunk except the last is filled to exactly DECOMP_CHUNK bytes, a
+ * multiple of the binary record size. Binary records still straddle two
+ * chunks, as the trace header in front of them shifts them against the
+ * chunks, and so do text lines; the reader keeps the unfinished record or
+ * line at the end of a chunk and gets it back in front of the next one.
+ *
+ * The codecs are optional: build with ZSTD=1 and/or LZ4=1 to link libzstd
+ * and liblz4. Without them compressed traces are still recognized, but
+ * refused.
+ */
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+enum compression { COMP_NONE, COMP_ZSTD, COMP_LZ4, COMPRESSIONS };
+
+// Decompressed bytes per chunk.
+#define DECOMP_CHUNK (1 << 20)
+// Most bytes of a chunk that can be kept for the next one.
+#define DECOMP_KEEP 256
+
+struct decompressor;
+
+extern const char *const compression_names[COMPRESSIONS];
+
+// Compression of the file starting with the len bytes at magic.
+enum compression compression_detect(const void *magic, size_t len);
+
+// Start decompressing file, which the decompressor takes over. The first
+// prefix_len bytes of the stream were already read from file and are passed
+// in prefix. Returns NULL (with a message on stderr) if the codec was not
+// built in.
+struct decompressor *decompressor_open(FILE *file, enum compression comp,
+                                       const char *filename,
+                                       const void *prefix, size_t prefix_len);
+
+// Release the current chunk and move to the next one, which starts with the
+// last keep bytes (at most DECOMP_KEEP) of the current one. Sets *data to the
+// start and returns the length including the kept bytes. At the end of the
+// stream there is no next chunk and only the kept bytes are returned.
+size_t decompressor_next(struct decompressor *d, const char **data,
+                         size_t keep);
+
+void decompressor_close(struct decompressor *d);
+
+#endif
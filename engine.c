@@ -0,0 +1,88 @@
+/*
+ * Filename: engine.c
+ * Epoch scheduler with work stealing, see engine.h.
+ */
+#include "engine.h"
+
+#include <omp.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Cores to run in one epoch on behalf of one worker. Entries are appended by
+// whichever worker finishes the core's previous task and claimed by the owner
+// or by thieves, both through next.
+struct task_queue {
+  _Alignas(64) atomic_int next; // next entry to claim
+  atomic_int len;
+  int *cores;
+};
+
+// Epoch e claims from queues[e % 3] and fills queues[(e + 1) % 3]. Each
+// worker clears its own queues[(e + 2) % 3] during epoch e: every claim from
+// it happened in epoch e - 1 and it is not filled again before epoch e + 1.
+#define EPOCH_QUEUES 3
+
+static void queue_push(struct task_queue *q, int core) {
+  q->cores[atomic_fetch_add_explicit(&q->len, 1, memory_order_relaxed)] = core;
+}
+
+void engine_run(int num_cores, int num_workers, engine_step step,
+                engine_epoch between, void *arg) {
+  if (num_workers > num_cores)
+    num_workers = num_cores;
+  struct task_queue *queues[EPOCH_QUEUES];
+  int per_worker = (num_cores + num_workers - 1) / num_workers;
+  for (int e = 0; e < EPOCH_QUEUES; e++) {
+    queues[e] = (struct task_queue *)aligned_alloc(
+        64, sizeof(struct task_queue) * num_workers);
+    for (int w = 0; w < num_workers; w++) {
+      atomic_init(&queues[e][w].next, 0);
+      atomic_init(&queues[e][w].len, 0);
+      queues[e][w].cores = (int *)malloc(sizeof(int) * per_worker);
+    }
+  }
+  for (int core = 0; core < num_cores; core++)
+    queue_push(&queues[0][core % num_workers], core);
+
+#pragma omp parallel num_threads(num_workers)
+  {
+    int self = omp_get_thread_num();
+    for (int epoch = 0;; epoch++) {
+      struct task_queue *now = queues[epoch % EPOCH_QUEUES];
+      struct task_queue *next = queues[(epoch + 1) % EPOCH_QUEUES];
+      struct task_queue *stale = &queues[(epoch + 2) % EPOCH_QUEUES][self];
+      atomic_store_explicit(&stale->next, 0, memory_order_relaxed);
+      atomic_store_explicit(&stale->len, 0, memory_order_relaxed);
+
+      // Drain our own queue first, then steal from the others in turn.
+      for (int k = 0; k < num_workers; k++) {
+        struct task_queue *q = &now[(self + k) % num_workers];
+        int len = atomic_load_explicit(&q->len, memory_order_relaxed);
+        int i;
+        while ((i = atomic_fetch_add_explicit(&q->next, 1,
+                                              memory_order_relaxed)) < len) {
+          int core = q->cores[i];
+          if (step(core, arg))
+            queue_push(&next[core % num_workers], core);
+        }
+      }
+
+#pragma omp barrier
+      int live = 0;
+      for (int w = 0; w < num_workers; w++)
+        live += atomic_load_explicit(&next[w].len, memory_order_relaxed);
+      if (!live)
+        break;
+      if (between) {
+#pragma omp single
+        between(epoch, arg);
+      }
+    }
+  }
+
+  for (int e = 0; e < EPOCH_QUEUES; e++) {
+    for (int w = 0; w < num_workers; w++)
+      free(queues[e][w].cores);
+    free(queues[e]);
+  }
+}
@@ -0,0 +1,28 @@
+/*
+ * Filename: engine.h
+ * Runs any number of simulated cores on a fixed pool of host threads.
+ *
+ * Simulated time advances in epochs. In every epoch each live core runs as
+ * one task that executes the core's next quantum of instructions. Tasks sit
+ * in per-worker queues: core i is queued on worker i % workers, which keeps
+ * cores on the same host thread while the load is even, and a worker that
+ * runs out of tasks steals from the queues of the others. Workers only
+ * synchronize at the end of an epoch, once every task of the epoch has run.
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+
+// Run the next quantum of core. Returns false once the core has finished.
+typedef bool (*engine_step)(int core, void *arg);
+
+// Called by one worker between epochs, while no core runs.
+typedef void (*engine_epoch)(int epoch, void *arg);
+
+// Run cores 0..num_cores - 1 on num_workers host threads until every one has
+// finished. between may be NULL.
+void engine_run(int num_cores, int num_workers, engine_step step,
+                engine_epoch between, void *arg);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Filename: frontend.c
+ * Batched trace decoding, see frontend.h.
+ */
+#include "frontend.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+struct frontend_ring *frontend_rings;
+
+static int rings;
+static int num_decoders;
+static thrd_t *decoder_threads;
+
+static void backoff(int *idle) {
+  if (++*idle < 64) {
+    thrd_yield();
+  } else {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 50000};
+    thrd_sleep(&ts, NULL);
+  }
+}
+
+// Decode the batch following the head published ones. Only the ring's
+// decoder calls this.
+static void decode_batch(struct frontend_ring *r, size_t head) {
+  size_t slot = head % FRONTEND_BLOCKS;
+  size_t len =
+      trace_read(r->trace, r->blocks + slot * FRONTEND_BATCH, FRONTEND_BATCH);
+  r->len[slot] = len;
+  if (len)
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  if (len < FRONTEND_BATCH)
+    atomic_store_explicit(&r->ended, true, memory_order_release);
+}
+
+// Keep every ring of this decoder full, one batch per ring in turn, until
+// all of its traces have ended.
+static int decoder_main(void *arg) {
+  int self = (int)(intptr_t)arg;
+  int idle = 0;
+  for (;;) {
+    bool live = false, worked = false;
+    for (int core = self; core < rings; core += num_decoders) {
+      struct frontend_ring *r = &frontend_rings[core];
+      if (atomic_load_explicit(&r->ended, memory_order_relaxed))
+        continue;
+      live = true;
+      size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+      if (head - atomic_load_explicit(&r->tail, memory_order_acquire) ==
+          FRONTEND_BLOCKS)
+        continue;
+      decode_batch(r, head);
+      worked = true;
+    }
+    if (!live)
+      return 0;
+    if (worked)
+      idle = 0;
+    else
+      backoff(&idle);
+  }
+}
+
+void frontend_start(int num_cores, trace **traces, int decoders) {
+  rings = num_cores;
+  num_decoders = decoders < num_cores ? decoders : num_cores;
+  frontend_rings = (struct frontend_ring *)aligned_alloc(
+      _Alignof(struct frontend_ring),
+      sizeof(struct frontend_ring) * num_cores);
+  for (int i = 0; i < num_cores; i++) {
+    struct frontend_ring *r = &frontend_rings[i];
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->ended, !traces[i]);
+    r->holding = false;
+    r->trace = traces[i];
+    r->blocks = (decoded *)aligned_alloc(
+        64, sizeof(decoded) * FRONTEND_BLOCKS * FRONTEND_BATCH);
+  }
+  decoder_threads = (thrd_t *)malloc(sizeof(thrd_t) * num_decoders);
+  for (int d = 0; d < num_decoders; d++)
+    thrd_create(&decoder_threads[d], decoder_main, (void *)(intptr_t)d);
+}
+
+bool frontend_refill(int core, struct frontend_cursor *cur) {
+  struct frontend_ring *r = &frontend_rings[core];
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (r->holding) {
+    atomic_store_explicit(&r->tail, ++tail, memory_order_release);
+    r->holding = false;
+  }
+  // Without decoder threads the core is its own decoder.
+  if (!num_decoders &&
+      !atomic_load_explicit(&r->ended, memory_order_relaxed))
+    decode_batch(r, tail);
+
+  int idle = 0;
+  while (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+    // The decoder publishes its last batch before it sets ended.
+    if (atomic_load_explicit(&r->ended, memory_order_acquire) &&
+        atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+      return false;
+    backoff(&idle);
+  }
+  size_t slot = tail % FRONTEND_BLOCKS;
+  r->holding = true;
+  cur->next = r->blocks + slot * FRONTEND_BATCH;
+  cur->end = cur->next + r->len[slot];
+  return true;
+}
+
+void frontend_finish(void) {
+  for (int d = 0; d < num_decoders; d++)
+    thrd_join(decoder_threads[d], NULL);
+  free(decoder_threads);
+  for (int i = 0; i < rings; i++)
+    free(frontend_rings[i].blocks);
+  free(frontend_rings);
+}
@@ -0,0 +1,67 @@
+/*
+ * Filename: frontend.h
+ * Trace decoding as a pipeline stage ahead of the simulation.
+ *
+ * Decoder threads read every core's trace in batches of FRONTEND_BATCH
+ * instructions and publish them into the core's single-producer ring of
+ * FRONTEND_BLOCKS batches, keeping up to that many batches decoded ahead of
+ * the core. The core then consumes whole batches: its simulation loop never
+ * runs the parser, and a batch of parsing runs without coherence work in
+ * between. A core only waits if decoding falls behind.
+ *
+ * Core i is decoded by decoder i % decoders. With no decoder threads each
+ * core decodes its next batch itself once it runs out, which still keeps
+ * parsing and simulation in separate loops.
+ */
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "trace.h"
+
+// Instructions per batch, and batches per ring.
+#define FRONTEND_BATCH 4096
+#define FRONTEND_BLOCKS 4
+
+// Producer and consumer fields sit on separate host cache lines.
+struct frontend_ring {
+  _Alignas(64) atomic_size_t head; // batches published by the decoder
+  atomic_bool ended;               // no batch follows the published ones
+  trace *trace;                    // NULL if the trace couldn't be opened
+  size_t len[FRONTEND_BLOCKS];     // instructions in each batch
+  decoded *blocks; // FRONTEND_BLOCKS * FRONTEND_BATCH instructions
+  _Alignas(64) atomic_size_t tail; // batches released by the core
+  bool holding;                    // the core is reading batch tail
+};
+
+// A core's position in its current batch.
+struct frontend_cursor {
+  const decoded *next, *end;
+};
+
+extern struct frontend_ring *frontend_rings;
+
+// Start decoders decoder threads for the traces of num_cores cores. traces
+// stay owned by the caller.
+void frontend_start(int num_cores, trace **traces, int decoders);
+
+// Release the core's current batch and move cur to the next one. Returns
+// false at the end of the trace.
+bool frontend_refill(int core, struct frontend_cursor *cur);
+
+// The next instruction of core.
+static inline bool frontend_next(int core, struct frontend_cursor *cur,
+                                 decoded *inst) {
+  if (cur->next == cur->end && !frontend_refill(core, cur))
+    return false;
+  *inst = *cur->next++;
+  return true;
+}
+
+// Wait for the decoders, once every core has reached the end of its trace.
+void frontend_finish(void);
+
+#endif
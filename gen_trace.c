@@ -0,0 +1,275 @@
+/*
+ * Filename: gen_trace.c
+ * Generates synthetic multi-core traces in the binary trace format, one file
+ * per simulated core.
+ *
+ * Patterns:
+ * - uniform: every core accesses the whole footprint uniformly at random.
+ * - zipf: every core draws from one Zipfian distribution over the footprint,
+ *   so all cores share the same hot set.
+ * - stream: every core walks its own region sequentially.
+ * - prodcons: even cores write a buffer in order, the next odd core reads
+ *   it back in the same order.
+ * - falseshare: every core reads and writes its own bytes, several cores'
+ *   bytes sharing each line.
+ * - lock: every core takes one shared lock word (read, then compare-and-swap),
+ *   touches a few shared bytes behind it and releases it again.
+ *
+ * usage: gen_trace [-p pattern] [-c cores] [-n insts] [-f footprint]
+ *                  [-w write_fraction] [-z exponent] [-l line] [-s seed]
+ *                  [-t] <prefix>
+ *
+ * Writes <prefix>_<core>.trc, or <prefix>_<core>.txt text traces with -t.
+ */
+#include "trace.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum pattern {
+  PAT_UNIFORM,
+  PAT_ZIPF,
+  PAT_STREAM,
+  PAT_PRODCONS,
+  PAT_FALSESHARE,
+  PAT_LOCK,
+  PATTERNS
+};
+
+static const char *const pattern_names[PATTERNS] = {
+    [PAT_UNIFORM] = "uniform",       [PAT_ZIPF] = "zipf",
+    [PAT_STREAM] = "stream",         [PAT_PRODCONS] = "prodcons",
+    [PAT_FALSESHARE] = "falseshare", [PAT_LOCK] = "lock",
+};
+
+static enum pattern pattern = PAT_UNIFORM;
+static int cores = 4;
+static uint64_t insts = 1000000;
+static uint64_t footprint = 1 << 20; // bytes shared by all cores
+static double write_fraction = 0.3;
+static double zipf_exponent = 0.99;
+static int line = 64; // bytes, for the patterns that care about lines
+static uint64_t seed = 1;
+static bool text;
+
+// Cumulative Zipf probabilities of the footprint's lines, most popular first.
+static double *zipf_cdf;
+static uint64_t zipf_items;
+
+struct generator {
+  uint64_t rng;
+  uint64_t step; // accesses generated so far
+};
+
+static uint64_t next_random(struct generator *g) {
+  uint64_t x = g->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return g->rng = x;
+}
+
+// Uniform in [0, 1).
+static double next_unit(struct generator *g) {
+  return (next_random(g) >> 11) * 0x1.0p-53;
+}
+
+static void zipf_init(void) {
+  zipf_items = footprint / line ? footprint / line : 1;
+  zipf_cdf = (double *)malloc(sizeof(double) * zipf_items);
+  double sum = 0;
+  for (uint64_t i = 0; i < zipf_items; i++)
+    zipf_cdf[i] = sum += 1 / pow((double)(i + 1), zipf_exponent);
+  for (uint64_t i = 0; i < zipf_items; i++)
+    zipf_cdf[i] /= sum;
+}
+
+static uint64_t zipf_line(struct generator *g) {
+  double u = next_unit(g);
+  uint64_t lo = 0, hi = zipf_items - 1;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (zipf_cdf[mid] < u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// The next access of core.
+static struct trace_record next_access(struct generator *g, int core) {
+  struct trace_record r = {.type = next_unit(g) < write_fraction
+                                       ? INST_WRITE
+                                       : INST_READ,
+                           .size = 1,
+                           .value = next_random(g) % 100};
+  uint64_t step = g->step++;
+  switch (pattern) {
+  case PAT_UNIFORM:
+    r.address = next_random(g) % footprint;
+    break;
+  case PAT_ZIPF:
+    r.address = zipf_line(g) * line + next_random(g) % line;
+    break;
+  case PAT_STREAM:
+    r.address = (uint64_t)core * footprint + step % footprint;
+    break;
+  case PAT_PRODCONS:
+    // Pair p owns its own buffer after the footprints of the pairs before.
+    r.type = core % 2 == 0 ? INST_WRITE : INST_READ;
+    r.address = (uint64_t)(core / 2) * footprint + step % footprint;
+    break;
+  case PAT_FALSESHARE: {
+    // Eight bytes per core, line / 8 cores per line.
+    int per_line = line / 8 ? line / 8 : 1;
+    r.address = (uint64_t)(core / per_line) * line +
+                (core % per_line) * 8 + step % 8;
+    break;
+  }
+  case PAT_LOCK:
+    // Read and take the lock at 0, touch the 3 shared bytes behind it in
+    // the critical section, then release the lock again.
+    switch (step % 6) {
+    case 0:
+      r.type = INST_READ;
+      r.address = 0;
+      break;
+    case 1:
+      r.type = INST_CAS;
+      r.address = 0;
+      r.value = 0;
+      r.operand = 1;
+      break;
+    case 5:
+      r.type = INST_WRITE;
+      r.address = 0;
+      r.value = 0;
+      break;
+    default:
+      r.address = line + step % 6 - 2;
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+  return r;
+}
+
+static bool write_trace(const char *path, int core) {
+  FILE *out = fopen(path, text ? "w" : "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  if (!text) {
+    struct trace_header header = {.version = TRACE_VERSION,
+                                  .record_size = sizeof(struct trace_record),
+                                  .count = insts};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, out);
+  }
+
+  struct generator g = {.rng = (seed + core) * 0x9e3779b97f4a7c15ULL | 1};
+  struct trace_record buf[TRACE_CHUNK];
+  for (uint64_t done = 0; done < insts;) {
+    size_t n = insts - done < TRACE_CHUNK ? insts - done : TRACE_CHUNK;
+    for (size_t i = 0; i < n; i++)
+      buf[i] = next_access(&g, core);
+    if (text) {
+      for (size_t i = 0; i < n; i++) {
+        unsigned long long address = buf[i].address;
+        if (buf[i].type == INST_CAS)
+          fprintf(out, "CAS %llu %llu %llu\n", address,
+                  (unsigned long long)buf[i].value,
+                  (unsigned long long)buf[i].operand);
+        else if (buf[i].type == INST_WRITE)
+          fprintf(out, "WR %llu %llu\n", address,
+                  (unsigned long long)buf[i].value);
+        else
+          fprintf(out, "RD %llu\n", address);
+      }
+    } else {
+      fwrite(buf, sizeof(struct trace_record), n, out);
+    }
+    done += n;
+  }
+  if (ferror(out) | fclose(out)) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+static int usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-p pattern] [-c cores] [-n insts] [-f footprint] "
+          "[-w write_fraction] [-z exponent] [-l line] [-s seed] [-t] "
+          "<prefix>\npatterns:",
+          name);
+  for (int p = 0; p < PATTERNS; p++)
+    fprintf(stderr, " %s", pattern_names[p]);
+  fprintf(stderr, "\n");
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "p:c:n:f:w:z:l:s:t")) != -1) {
+    switch (opt) {
+    case 'p': {
+      int p = 0;
+      while (p < PATTERNS && strcmp(optarg, pattern_names[p]))
+        p++;
+      if (p == PATTERNS)
+        return usage(argv[0]);
+      pattern = p;
+      break;
+    }
+    case 'c':
+      cores = atoi(optarg);
+      break;
+    case 'n':
+      insts = strtoull(optarg, NULL, 0);
+      break;
+    case 'f':
+      footprint = strtoull(optarg, NULL, 0);
+      break;
+    case 'w':
+      write_fraction = atof(optarg);
+      break;
+    case 'z':
+      zipf_exponent = atof(optarg);
+      break;
+    case 'l':
+      line = atoi(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      text = true;
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind + 1 != argc || cores <= 0 || !footprint || line <= 0)
+    return usage(argv[0]);
+  if (pattern == PAT_ZIPF)
+    zipf_init();
+
+  for (int core = 0; core < cores; core++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s_%d.%s", argv[optind], core,
+             text ? "txt" : "trc");
+    if (!write_trace(path, core))
+      return 1;
+    printf("%s: %llu records\n", path, (unsigned long long)insts);
+  }
+  free(zipf_cdf);
+  return 0;
+}
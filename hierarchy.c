@@ -0,0 +1,154 @@
+/*
+ * Filename: hierarchy.c
+ * Tag-only cache levels and the banked LLC, see hierarchy.h.
+ */
+#include "hierarchy.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "tag_match.h"
+
+const char *const inclusion_names[INCLUSIONS] = {
+    [INCL_INCLUSIVE] = "inclusive",
+    [INCL_EXCLUSIVE] = "exclusive",
+    [INCL_NINE] = "nine",
+};
+
+int inclusion_parse(const char *name) {
+  for (int i = 0; i < INCLUSIONS; i++) {
+    if (!strcmp(name, inclusion_names[i]))
+      return i;
+  }
+  return -1;
+}
+
+void tag_cache_init(struct tag_cache *tc, struct arena *a, int sets, int ways,
+                    enum repl_policy policy, uint64_t seed) {
+  size_t lines = (size_t)sets * ways;
+  tc->sets = sets;
+  tc->ways = ways;
+  tc->tags = (uint64_t *)arena_alloc(a, sizeof(uint64_t) * lines);
+  tc->valid = (uint8_t *)arena_alloc(a, lines + TAG_MATCH_PAD);
+  repl_init(&tc->repl, a, policy, sets, ways, seed);
+}
+
+void tag_cache_checkpoint(struct checkpoint *ck, struct tag_cache *tc) {
+  size_t lines = (size_t)tc->sets * tc->ways;
+  ckpt_bytes(ck, tc->tags, sizeof(uint64_t) * lines);
+  ckpt_bytes(ck, tc->valid, lines);
+  repl_checkpoint(ck, &tc->repl, tc->sets, tc->ways);
+}
+
+// The lower levels run at any associativity, so they use the generic
+// dispatch on policy instead of specialized kernels. They only see L1 misses.
+static int tc_find(struct tag_cache *tc, size_t base, uint64_t line) {
+  return tag_find(tc->tags + base, tc->valid + base, line, tc->ways);
+}
+
+bool tag_cache_lookup(struct tag_cache *tc, int set, uint64_t line,
+                      enum repl_policy policy, bool touch) {
+  size_t base = (size_t)set * tc->ways;
+  int way = tc_find(tc, base, line);
+  if (way < 0)
+    return false;
+  if (touch)
+    repl_hit(&tc->repl, set, base, way, tc->ways, policy);
+  return true;
+}
+
+bool tag_cache_insert(struct tag_cache *tc, int set, uint64_t line,
+                      enum repl_policy policy, uint64_t *victim) {
+  size_t base = (size_t)set * tc->ways;
+  int way = tc_find(tc, base, line);
+  if (way >= 0) {
+    repl_hit(&tc->repl, set, base, way, tc->ways, policy);
+    return false;
+  }
+  way = find_invalid(tc->valid + base, tc->ways);
+  bool replaced = way < 0;
+  if (replaced) {
+    way = repl_victim(&tc->repl, set, base, tc->ways, policy);
+    *victim = tc->tags[base + way];
+  }
+  tc->tags[base + way] = line;
+  tc->valid[base + way] = 1;
+  repl_fill(&tc->repl, set, base, way, tc->ways, policy);
+#ifdef DEBUG
+  for (int w = 0; w < tc->ways; w++)
+    assert(w == way || !tc->valid[base + w] || tc->tags[base + w] != line);
+#endif
+  return replaced;
+}
+
+bool tag_cache_remove(struct tag_cache *tc, int set, uint64_t line) {
+  size_t base = (size_t)set * tc->ways;
+  int way = tc_find(tc, base, line);
+  if (way < 0)
+    return false;
+  tc->valid[base + way] = 0;
+  return true;
+}
+
+void llc_init(struct llc *llc, struct arena *a, int sets, int ways, int banks,
+              enum inclusion inclusion, enum repl_policy policy) {
+  llc->sets = sets;
+  llc->banks = banks;
+  llc->inclusion = inclusion;
+  llc->bank =
+      (struct llc_bank *)arena_alloc(a, sizeof(struct llc_bank) * banks);
+  // While sizing, carve the banks' caches without a bank to hold them.
+  struct llc_bank sizing;
+  for (int b = 0; b < banks; b++) {
+    struct llc_bank *bank = arena_sizing(a) ? &sizing : &llc->bank[b];
+    if (!arena_sizing(a))
+      omp_init_lock(&bank->lock);
+    tag_cache_init(&bank->tc, a, sets / banks, ways, policy, b + 1);
+  }
+}
+
+void llc_destroy(struct llc *llc) {
+  for (int b = 0; b < llc->banks; b++)
+    omp_destroy_lock(&llc->bank[b].lock);
+}
+
+static struct llc_bank *llc_bank_of(struct llc *llc, uint64_t block,
+                                    int *set) {
+  int s = block % llc->sets;
+  *set = s / llc->banks;
+  return &llc->bank[s % llc->banks];
+}
+
+bool llc_lookup(struct llc *llc, uint64_t block, uint64_t line,
+                enum repl_policy policy, bool touch) {
+  int set;
+  struct llc_bank *b = llc_bank_of(llc, block, &set);
+  omp_set_lock(&b->lock);
+  bool hit = tag_cache_lookup(&b->tc, set, line, policy, touch);
+  omp_unset_lock(&b->lock);
+  return hit;
+}
+
+bool llc_insert(struct llc *llc, uint64_t block, uint64_t line,
+                enum repl_policy policy, uint64_t *victim) {
+  int set;
+  struct llc_bank *b = llc_bank_of(llc, block, &set);
+  omp_set_lock(&b->lock);
+  bool replaced = tag_cache_insert(&b->tc, set, line, policy, victim);
+  omp_unset_lock(&b->lock);
+  return replaced;
+}
+
+bool llc_remove(struct llc *llc, uint64_t block, uint64_t line) {
+  int set;
+  struct llc_bank *b = llc_bank_of(llc, block, &set);
+  omp_set_lock(&b->lock);
+  bool removed = tag_cache_remove(&b->tc, set, line);
+  omp_unset_lock(&b->lock);
+  return removed;
+}
+
+void llc_checkpoint(struct checkpoint *ck, struct llc *llc) {
+  for (int b = 0; b < llc->banks; b++)
+    tag_cache_checkpoint(ck, &llc->bank[b].tc);
+}
@@ -0,0 +1,94 @@
+/*
+ * Filename: hierarchy.h
+ * Cache levels below each core's L1: a private L2 per core and a shared,
+ * banked last level cache (LLC) in front of memory.
+ *
+ * Data, and with it the coherence state, lives in the L1s and in memory.
+ * Lines leave an L1 through write-backs to memory, so memory always holds
+ * the contents the lower levels would have. The lower levels therefore only
+ * track which lines they hold, which decides where a fill is served from
+ * and which lines the inclusion policies have to invalidate.
+ *
+ * The L2 is inclusive of its L1: evicting an L2 line invalidates it in the
+ * L1 as well. The LLC is inclusive of all private caches, exclusive of them
+ * (filled by lines leaving a private L2, or L1 without one, and emptied by
+ * hits), or neither (NINE). Every bank of the LLC has its own lock, so cores
+ * missing into different banks proceed in parallel.
+ *
+ * The L2 and the LLC need a multiple of the L1's sets, so every line sharing
+ * an L2 or LLC set with a block also shares the block's L1 set lock.
+ */
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <omp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "checkpoint.h"
+#include "replacement.h"
+
+enum inclusion { INCL_INCLUSIVE, INCL_EXCLUSIVE, INCL_NINE, INCLUSIONS };
+
+// A cache level that only tracks which lines it holds.
+struct tag_cache {
+  int sets, ways;
+  uint64_t *tags;
+  uint8_t *valid; // plus TAG_MATCH_PAD bytes
+  struct repl_state repl;
+};
+
+struct llc_bank {
+  _Alignas(64) omp_lock_t lock;
+  struct tag_cache tc;
+};
+
+// LLC set s is set s / banks of bank s % banks.
+struct llc {
+  int sets, banks;
+  enum inclusion inclusion;
+  struct llc_bank *bank;
+};
+
+extern const char *const inclusion_names[INCLUSIONS];
+
+// Inclusion policy called name, or -1.
+int inclusion_parse(const char *name);
+
+// Carve an empty cache from a.
+void tag_cache_init(struct tag_cache *tc, struct arena *a, int sets, int ways,
+                    enum repl_policy policy, uint64_t seed);
+
+// Save or restore the contents of tc.
+void tag_cache_checkpoint(struct checkpoint *ck, struct tag_cache *tc);
+
+// Whether tc holds line, in set set. Hits update the policy if touch is set.
+bool tag_cache_lookup(struct tag_cache *tc, int set, uint64_t line,
+                      enum repl_policy policy, bool touch);
+
+// Insert line. A line that is already present is only touched, so a set
+// never holds a tag twice; an exclusive LLC gets the same line from every
+// sharer that evicts it. Returns true and sets *victim if it replaced a valid
+// line.
+bool tag_cache_insert(struct tag_cache *tc, int set, uint64_t line,
+                      enum repl_policy policy, uint64_t *victim);
+
+// Drop line if present. Returns whether it was.
+bool tag_cache_remove(struct tag_cache *tc, int set, uint64_t line);
+
+// Carve an empty LLC from a. llc_destroy() releases the bank locks, the
+// memory goes with the arena.
+void llc_init(struct llc *llc, struct arena *a, int sets, int ways, int banks,
+              enum inclusion inclusion, enum repl_policy policy);
+void llc_destroy(struct llc *llc);
+void llc_checkpoint(struct checkpoint *ck, struct llc *llc);
+
+// The tag_cache operations on the LLC set of block, under its bank lock.
+bool llc_lookup(struct llc *llc, uint64_t block, uint64_t line,
+                enum repl_policy policy, bool touch);
+bool llc_insert(struct llc *llc, uint64_t block, uint64_t line,
+                enum repl_policy policy, uint64_t *victim);
+bool llc_remove(struct llc *llc, uint64_t block, uint64_t line);
+
+#endif
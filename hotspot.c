@@ -0,0 +1,201 @@
+/*
+ * Filename: hotspot.c
+ * Per-core line tables and their merged report, see hotspot.h.
+ */
+#include "hotspot.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+int hotspot_lines;
+
+static uint64_t events(const struct hotspot_line *e) {
+  return (uint64_t)e->accesses + e->invalidations + e->transfers;
+}
+
+static struct hotspot_line *set_of(struct hotspot_table *h, uint64_t block) {
+  uint64_t hash = block * 0x9e3779b97f4a7c15ULL;
+  return &h->lines[(hash >> 32) % HOTSPOT_SETS * HOTSPOT_WAYS];
+}
+
+// The entry of block in h, or NULL.
+static struct hotspot_line *find(struct hotspot_table *h, uint64_t block) {
+  struct hotspot_line *set = set_of(h, block);
+  for (int w = 0; w < HOTSPOT_WAYS; w++) {
+    if (set[w].tag == block + 1)
+      return &set[w];
+  }
+  return NULL;
+}
+
+// The entry of block in h, replacing the one with the fewest events if the
+// block has none.
+static struct hotspot_line *claim(struct hotspot_table *h, uint64_t block) {
+  struct hotspot_line *set = set_of(h, block), *victim = set;
+  for (int w = 0; w < HOTSPOT_WAYS; w++) {
+    if (set[w].tag == block + 1)
+      return &set[w];
+    if (events(&set[w]) < events(victim))
+      victim = &set[w];
+  }
+  memset(victim, 0, sizeof(*victim));
+  victim->tag = block + 1;
+  return victim;
+}
+
+// Bit of the byte at offset in the masks of a line of line_size bytes.
+static uint64_t byte_bit(int offset, int line_size) {
+  return 1ULL << (line_size > 64 ? offset * 64 / line_size : offset);
+}
+
+void hotspot_access(struct hotspot_table *h, uint64_t address, int size,
+                    bool write, int line_size) {
+  if (!h->recording)
+    return;
+  for (int i = 0; i < size;) {
+    uint64_t a = address + i;
+    struct hotspot_line *e = claim(h, a / line_size);
+    e->accesses++;
+    e->writes += write;
+    for (int offset = a % line_size; i < size && offset < line_size;
+         i++, offset++) {
+      uint64_t bit = byte_bit(offset, line_size);
+      e->touched |= bit;
+      if (write)
+        e->written |= bit;
+    }
+  }
+}
+
+void hotspot_coherence(struct hotspot_table *h, uint64_t line, int line_size,
+                       uint64_t invalidations, bool transfer) {
+  if (!h->recording || (!invalidations && !transfer))
+    return;
+  struct hotspot_line *e = claim(h, line / line_size);
+  e->invalidations += invalidations;
+  e->transfers += transfer;
+  e->handoffs++;
+}
+
+// A line merged over every core.
+struct hotspot {
+  uint64_t tag, touched, written;
+  uint64_t accesses, writes, invalidations, transfers, handoffs;
+  int cores;
+  bool overlap; // some core touched a byte another core wrote
+};
+
+// Most handoffs first, then most invalidations, then most accesses.
+static int by_contention(const void *pa, const void *pb) {
+  const struct hotspot *a = (const struct hotspot *)pa;
+  const struct hotspot *b = (const struct hotspot *)pb;
+  if (a->handoffs != b->handoffs)
+    return a->handoffs < b->handoffs ? 1 : -1;
+  if (a->invalidations != b->invalidations)
+    return a->invalidations < b->invalidations ? 1 : -1;
+  if (a->accesses != b->accesses)
+    return a->accesses < b->accesses ? 1 : -1;
+  return a->tag < b->tag ? -1 : a->tag > b->tag;
+}
+
+// Print the bytes of a line of line_size bytes whose bits are set in mask,
+// as ranges like "0-3,8".
+static void print_bytes(FILE *out, uint64_t mask, int line_size) {
+  int bits = line_size < 64 ? line_size : 64;
+  const char *sep = "";
+  for (int b = 0; b < bits; b++) {
+    if (!(mask >> b & 1))
+      continue;
+    int e = b;
+    while (e + 1 < bits && mask >> (e + 1) & 1)
+      e++;
+    // bit b holds the bytes from b * line_size / 64 rounded up
+    int first = line_size > 64 ? (b * line_size + 63) / 64 : b;
+    int last = line_size > 64 ? ((e + 1) * line_size + 63) / 64 - 1 : e;
+    if (first == last)
+      fprintf(out, "%s%d", sep, first);
+    else
+      fprintf(out, "%s%d-%d", sep, first, last);
+    sep = ",";
+    b = e;
+  }
+}
+
+void hotspot_report(FILE *out, struct hotspot_table *const *tables,
+                    int num_cores, int line_size) {
+  size_t used = 0, cap = 1;
+  for (int core = 0; core < num_cores; core++) {
+    for (size_t i = 0; i < HOTSPOT_SETS * HOTSPOT_WAYS; i++)
+      used += tables[core]->lines[i].tag != 0;
+  }
+  while (cap < 2 * used)
+    cap *= 2;
+
+  // Open addressing on the tag, 0 marking free slots as in the tables.
+  struct hotspot *merged = (struct hotspot *)calloc(cap, sizeof(*merged));
+  for (int core = 0; core < num_cores; core++) {
+    for (size_t i = 0; i < HOTSPOT_SETS * HOTSPOT_WAYS; i++) {
+      const struct hotspot_line *e = &tables[core]->lines[i];
+      if (!e->tag)
+        continue;
+      size_t slot = (e->tag * 0x9e3779b97f4a7c15ULL >> 32) & (cap - 1);
+      while (merged[slot].tag && merged[slot].tag != e->tag)
+        slot = (slot + 1) & (cap - 1);
+      struct hotspot *m = &merged[slot];
+      m->tag = e->tag;
+      m->overlap |= (e->written & m->touched) || (e->touched & m->written);
+      m->touched |= e->touched;
+      m->written |= e->written;
+      m->accesses += e->accesses;
+      m->writes += e->writes;
+      m->invalidations += e->invalidations;
+      m->transfers += e->transfers;
+      m->handoffs += e->handoffs;
+      m->cores++;
+    }
+  }
+
+  // Keep the contended lines.
+  size_t contended = 0;
+  for (size_t i = 0; i < cap; i++) {
+    if (merged[i].tag && (merged[i].handoffs || merged[i].invalidations))
+      merged[contended++] = merged[i];
+  }
+  qsort(merged, contended, sizeof(*merged), by_contention);
+  size_t shown = contended < (size_t)hotspot_lines ? contended
+                                                   : (size_t)hotspot_lines;
+
+  fprintf(out, "hotspots: %zu of %zu contended lines\n", shown, contended);
+  fprintf(out, "%-18s %6s %12s %12s %14s %12s %12s  %s\n", "line", "cores",
+          "accesses", "writes", "invalidations", "transfers", "handoffs",
+          "sharing");
+  for (size_t i = 0; i < shown; i++) {
+    const struct hotspot *m = &merged[i];
+    // Without a write, or with a single core left in the tables, there is
+    // no telling true from false sharing.
+    bool shared = m->cores > 1 && m->written;
+    fprintf(out,
+            "0x%016" PRIx64 " %6d %12" PRIu64 " %12" PRIu64 " %14" PRIu64
+            " %12" PRIu64 " %12" PRIu64 "  %s\n",
+            (m->tag - 1) * line_size, m->cores, m->accesses, m->writes,
+            m->invalidations, m->transfers, m->handoffs,
+            !shared ? "-" : m->overlap ? "true" : "false");
+    if (!shared || m->overlap)
+      continue;
+    // Show how the cores split a falsely shared line.
+    for (int core = 0; core < num_cores; core++) {
+      const struct hotspot_line *e = find(tables[core], m->tag - 1);
+      if (!e)
+        continue;
+      fprintf(out, "  core %d: bytes ", core);
+      print_bytes(out, e->touched, line_size);
+      if (e->written) {
+        fprintf(out, ", written ");
+        print_bytes(out, e->written, line_size);
+      }
+      fprintf(out, "\n");
+    }
+  }
+  free(merged);
+}
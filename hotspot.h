@@ -0,0 +1,65 @@
+/*
+ * Filename: hotspot.h
+ * Per-line contention profile and the report of its hottest lines.
+ *
+ * With profiling on, every core keeps a table of the lines it uses, and for
+ * each line counts its accesses, the copies it invalidated in other cores,
+ * the fills another core supplied cache to cache, and the handoffs: accesses
+ * that had to take the line away from another core, by invalidating its copy
+ * or by getting it from that core. A line bouncing between cores has one
+ * handoff per bounce. Each entry also has one bit per byte of the line the
+ * core read or wrote, and per byte it wrote; lines longer than 64 bytes get
+ * one bit per 1/64th of the line.
+ *
+ * A table is only touched by its own core, under no lock of its own, and
+ * the tables are merged once the run is over. A line shared by several
+ * cores is falsely shared if it was invalidated, while no core wrote a byte
+ * another core touched.
+ *
+ * The tables are fixed in size, HOTSPOT_SETS sets of HOTSPOT_WAYS lines,
+ * and a line that finds its set full replaces the line with the fewest
+ * events. The counts of a replaced line are lost, which the cold lines that
+ * get replaced can afford: the hot lines stay, and their counts are exact.
+ */
+#ifndef HOTSPOT_H
+#define HOTSPOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HOTSPOT_SETS 4096
+#define HOTSPOT_WAYS 8
+
+// Lines in the report, 0 for no profiling.
+extern int hotspot_lines;
+
+struct hotspot_line {
+  uint64_t tag;     // block number + 1, 0 while the entry is free
+  uint64_t touched; // bytes read or written
+  uint64_t written; // bytes written
+  uint32_t accesses, writes;
+  uint32_t invalidations, transfers, handoffs;
+};
+
+// The lines of one core.
+struct hotspot_table {
+  bool recording; // count the core's accesses, false while fast-forwarding
+  struct hotspot_line lines[HOTSPOT_SETS * HOTSPOT_WAYS];
+};
+
+// Count an access of size bytes at address, of lines of line_size bytes.
+void hotspot_access(struct hotspot_table *h, uint64_t address, int size,
+                    bool write, int line_size);
+
+// Count the coherence events of one access to the line at line: the other
+// copies it invalidated, and whether another core supplied the line.
+void hotspot_coherence(struct hotspot_table *h, uint64_t line, int line_size,
+                       uint64_t invalidations, bool transfer);
+
+// Merge the tables of num_cores cores and print the hotspot_lines lines with
+// the most handoffs.
+void hotspot_report(FILE *out, struct hotspot_table *const *tables,
+                    int num_cores, int line_size);
+
+#endif
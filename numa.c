@@ -0,0 +1,62 @@
+/*
+ * Filename: numa.c
+ * Topology options and the traffic report, see numa.h.
+ */
+#include "numa.h"
+
+#include <inttypes.h>
+
+#include "stats.h"
+
+int numa_sockets = 1;
+uint64_t numa_interleave = 4096;
+
+bool numa_parse(const char *spec) {
+  int n = sscanf(spec, "%d:%" SCNu64, &numa_sockets, &numa_interleave);
+  return n >= 1 && numa_sockets > 0 && numa_sockets <= NUMA_MAX_SOCKETS &&
+         numa_interleave > 0;
+}
+
+void numa_report(FILE *out, int num_cores, int line_size) {
+  // Bandwidths are over the run, as long as its slowest core.
+  uint64_t cycles = 0;
+  core_stats total = stats_total();
+  for (int core = 0; core < num_cores; core++) {
+    if (stats[core]->cycles > cycles)
+      cycles = stats[core]->cycles;
+  }
+  double per_cycle = cycles ? 1.0 / cycles : 0;
+
+  fprintf(out, "numa: %d sockets, %" PRIu64 "-byte interleave, %" PRIu64
+          " cycles\n", numa_sockets, numa_interleave, cycles);
+  fprintf(out, "%-8s %-10s %14s %14s %12s\n", "socket", "cores",
+          "mem_reads", "mem_writes", "bytes/cycle");
+  for (int s = 0; s < numa_sockets; s++) {
+    char cores[24] = "-";
+    int first = 0, last = num_cores - 1;
+    while (first < num_cores && numa_socket(first, num_cores) < s)
+      first++;
+    while (last >= 0 && numa_socket(last, num_cores) > s)
+      last--;
+    if (first < last)
+      snprintf(cores, sizeof(cores), "%d-%d", first, last);
+    else if (first == last)
+      snprintf(cores, sizeof(cores), "%d", first);
+    uint64_t lines = total.mem_reads[s] + total.mem_writes[s];
+    fprintf(out, "%-8d %-10s %14" PRIu64 " %14" PRIu64 " %12.3f\n", s, cores,
+            total.mem_reads[s], total.mem_writes[s],
+            (double)lines * line_size * per_cycle);
+  }
+  fprintf(out, "%-8s %-10s %14s %14s %12s\n", "link", "", "bytes", "",
+          "bytes/cycle");
+  for (int from = 0; from < numa_sockets; from++) {
+    for (int to = 0; to < numa_sockets; to++) {
+      if (from == to)
+        continue;
+      char link[32];
+      snprintf(link, sizeof(link), "%d -> %d", from, to);
+      fprintf(out, "%-19s %14" PRIu64 " %14s %12.3f\n", link,
+              total.link[from][to], "", total.link[from][to] * per_cycle);
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/*
+ * Filename: numa.h
+ * Multi-socket topology: which socket each core and each memory block is on.
+ *
+ * The cores are split into numa_sockets sockets of consecutive cores, and
+ * memory is interleaved over the sockets in numa_interleave byte chunks: the
+ * socket a chunk falls on is the home node of its lines. The home node holds
+ * the memory controller serving the line, the line's directory entry and its
+ * slice of the LLC, which stays one shared cache whose lines each sit with
+ * their home.
+ *
+ * Every step of an access that leaves the core's socket crosses the link
+ * between the sockets: a fill from a remote home, a lookup of the directory
+ * at a remote home, snoops of cores on other sockets and their answers,
+ * lines another socket's caches supply, and write-backs to a remote home.
+ * Each such message is counted per pair of sockets, as NUMA_CONTROL_BYTES
+ * for requests, answers and invalidations, and that plus a line for data.
+ * An access pays LAT_LINK once for reaching a remote home and once for
+ * snooping other sockets, which run in parallel over the sockets reached,
+ * and each remote write-back pays it too.
+ *
+ * With a single socket, the default, nothing is counted or charged.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define NUMA_MAX_SOCKETS 4
+// Bytes of a message without a line: a request, an answer, an invalidation.
+#define NUMA_CONTROL_BYTES 8
+
+extern int numa_sockets;
+extern uint64_t numa_interleave;
+
+// Home node of address.
+static inline int numa_home(uint64_t address) {
+  return address / numa_interleave % numa_sockets;
+}
+
+// Socket of core of num_cores.
+static inline int numa_socket(int core, int num_cores) {
+  return (int)((int64_t)core * numa_sockets / num_cores);
+}
+
+// Set the topology from spec, "sockets[:interleave bytes]". Returns false if
+// spec is invalid.
+bool numa_parse(const char *spec);
+
+// Print the traffic of every memory controller and link of a run of
+// num_cores cores with lines of line_size bytes, from the counters in
+// stats.h.
+void numa_report(FILE *out, int num_cores, int line_size);
+
+#endif
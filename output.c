@@ -0,0 +1,259 @@
+/*
+ * Filename: output.c
+ * Ring buffers and the writer thread behind output.h.
+ */
+#include "output.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum output_mode output_mode = OUTPUT_ASYNC;
+struct out_ring *out_rings;
+
+static int rings;
+static FILE *out_file;
+static thrd_t writer;
+
+// Formatted output is flushed to out_file in chunks of this size.
+#define OUT_BUF_SIZE (1 << 20)
+// Longest line format_event() can produce.
+#define OUT_LINE_MAX 96
+
+static char *out_buf;
+static size_t out_len;
+
+// Append n in decimal, zero padded to at least width digits.
+static char *put_u64(char *p, uint64_t n, int width) {
+  char digits[20];
+  int len = 0;
+  do {
+    digits[len++] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  for (; width > len; width--)
+    *p++ = '0';
+  while (len)
+    *p++ = digits[--len];
+  return p;
+}
+
+// Append n like "%0<width>d", where the sign counts towards the width.
+static char *put_int(char *p, int64_t n, int width) {
+  if (n < 0) {
+    *p++ = '-';
+    return put_u64(p, -(uint64_t)n, width - 1);
+  }
+  return put_u64(p, n, width);
+}
+
+static char *put_str(char *p, const char *s, size_t len) {
+  memcpy(p, s, len);
+  return p + len;
+}
+
+static void flush_buf(void) {
+  fwrite(out_buf, 1, out_len, out_file);
+  out_len = 0;
+}
+
+// What each instruction type does, all of the same length.
+static const char *const event_names[INST_TYPES] = {
+    [INST_READ] = " Reading from address ",
+    [INST_WRITE] = " Writing   to address ",
+    [INST_CAS] = " Swapping  at address ",
+    [INST_FAA] = " Adding    to address ",
+};
+
+// Same text as "Core %d Reading from address %02" PRIu64 ": %02d\n", or
+// "Core %d Fence\n" for a fence.
+static void format_event(int core, const struct out_event *e) {
+  if (out_len + OUT_LINE_MAX > OUT_BUF_SIZE)
+    flush_buf();
+  char *p = out_buf + out_len;
+  p = put_str(p, "Core ", 5);
+  p = put_int(p, core, 0);
+  if (e->type == INST_FENCE) {
+    p = put_str(p, " Fence\n", 7);
+    out_len = p - out_buf;
+    return;
+  }
+  p = put_str(p, event_names[e->type], 22);
+  p = put_u64(p, e->address, 2);
+  p = put_str(p, ": ", 2);
+  p = put_int(p, e->value, 2);
+  *p++ = '\n';
+  out_len = p - out_buf;
+}
+
+static void backoff(int *idle) {
+  if (++*idle < 64) {
+    thrd_yield();
+  } else {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 50000};
+    thrd_sleep(&ts, NULL);
+  }
+}
+
+// Drain every ring in turn.
+static void write_async(void) {
+  int idle = 0;
+  for (;;) {
+    bool progress = false, all_done = true;
+    for (int i = 0; i < rings; i++) {
+      struct out_ring *r = &out_rings[i];
+      // read done before head, so a finished ring is seen with all events
+      bool done = atomic_load_explicit(&r->done, memory_order_acquire);
+      size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+      size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+      for (; tail != head; tail++)
+        format_event(i, &r->events[tail & (OUTPUT_RING_SIZE - 1)]);
+      if (tail != atomic_load_explicit(&r->tail, memory_order_relaxed)) {
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+        progress = true;
+      }
+      all_done &= done;
+    }
+    if (progress) {
+      idle = 0;
+    } else if (all_done) {
+      return;
+    } else {
+      backoff(&idle);
+    }
+  }
+}
+
+// Merge the rings by (clock, core). A ring that is empty but not done still
+// bounds the merge: its next event has a clock above the last one it sent.
+static void write_ordered(void) {
+  uint64_t *next_min = (uint64_t *)calloc(rings, sizeof(uint64_t));
+  size_t *heads = (size_t *)calloc(rings, sizeof(size_t));
+  size_t *tails = (size_t *)calloc(rings, sizeof(size_t));
+  bool *done = (bool *)calloc(rings, sizeof(bool));
+  int idle = 0;
+
+  for (;;) {
+    for (int i = 0; i < rings; i++) {
+      if (tails[i] == heads[i] && !done[i]) {
+        done[i] =
+            atomic_load_explicit(&out_rings[i].done, memory_order_acquire);
+        heads[i] =
+            atomic_load_explicit(&out_rings[i].head, memory_order_acquire);
+      }
+    }
+
+    long emitted = 0;
+    for (;;) {
+      // Smallest pending (clock, core), and whether a ring that has nothing
+      // queued could still produce something before it.
+      int best = -1;
+      uint64_t best_clock = 0;
+      bool blocked = false;
+      for (int i = 0; i < rings; i++) {
+        if (tails[i] != heads[i]) {
+          uint64_t clock =
+              out_rings[i].events[tails[i] & (OUTPUT_RING_SIZE - 1)].clock;
+          if (best < 0 || clock < best_clock) {
+            best = i;
+            best_clock = clock;
+          }
+        }
+      }
+      if (best < 0)
+        break;
+      for (int i = 0; i < rings && !blocked; i++) {
+        if (tails[i] == heads[i] && !done[i])
+          blocked = next_min[i] < best_clock ||
+                    (next_min[i] == best_clock && i < best);
+      }
+      if (blocked)
+        break;
+      struct out_event *e =
+          &out_rings[best].events[tails[best] & (OUTPUT_RING_SIZE - 1)];
+      format_event(best, e);
+      next_min[best] = e->clock + 1;
+      tails[best]++;
+      emitted++;
+      if (tails[best] == heads[best])
+        break;
+    }
+
+    bool all_done = true;
+    for (int i = 0; i < rings; i++) {
+      atomic_store_explicit(&out_rings[i].tail, tails[i],
+                            memory_order_release);
+      all_done &= done[i] && tails[i] == heads[i];
+    }
+    if (all_done)
+      break;
+    if (emitted)
+      idle = 0;
+    else
+      backoff(&idle);
+  }
+
+  free(next_min);
+  free(heads);
+  free(tails);
+  free(done);
+}
+
+static int writer_main(void *arg) {
+  (void)arg;
+  if (output_mode == OUTPUT_ORDERED)
+    write_ordered();
+  else
+    write_async();
+  flush_buf();
+  fflush(out_file);
+  return 0;
+}
+
+void output_start(int num_cores, FILE *out) {
+  rings = num_cores;
+  out_file = out;
+  out_rings = (struct out_ring *)aligned_alloc(
+      64, sizeof(struct out_ring) * num_cores);
+  for (int i = 0; i < num_cores; i++) {
+    struct out_ring *r = &out_rings[i];
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->done, false);
+    r->cached_tail = 0;
+    r->events = output_mode == OUTPUT_QUIET
+                    ? NULL
+                    : (struct out_event *)malloc(sizeof(struct out_event) *
+                                                 OUTPUT_RING_SIZE);
+  }
+  if (output_mode != OUTPUT_QUIET) {
+    out_buf = (char *)malloc(OUT_BUF_SIZE);
+    thrd_create(&writer, writer_main, NULL);
+  }
+}
+
+void output_wait_space(struct out_ring *r) {
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  int idle = 0;
+  while ((r->cached_tail = atomic_load_explicit(
+              &r->tail, memory_order_acquire)) +
+             OUTPUT_RING_SIZE ==
+         head)
+    backoff(&idle);
+}
+
+void output_core_done(int core) {
+  atomic_store_explicit(&out_rings[core].done, true, memory_order_release);
+}
+
+void output_finish(void) {
+  if (output_mode != OUTPUT_QUIET) {
+    thrd_join(writer, NULL);
+    free(out_buf);
+  }
+  for (int i = 0; i < rings; i++) {
+    free(out_rings[i].events);
+  }
+  free(out_rings);
+}
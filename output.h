@@ -0,0 +1,82 @@
+/*
+ * Filename: output.h
+ * Asynchronous per-access output.
+ *
+ * Cores never format or write output themselves. Each core appends fixed-size
+ * event records to its own single-producer ring buffer, and a dedicated
+ * writer thread drains the rings, formats the records and writes them out in
+ * large batches. A core only waits if its ring is full.
+ *
+ * Modes:
+ * - OUTPUT_ASYNC: lines appear in whatever order the writer drains them.
+ * - OUTPUT_ORDERED: lines are merged by (clock, core), so the output order
+ *   does not depend on host scheduling. clock must increase strictly with
+ *   every event of a core.
+ * - OUTPUT_QUIET: no per-access lines at all; the simulator prints its
+ *   statistics instead, see stats.h.
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include "trace.h"
+
+enum output_mode { OUTPUT_ASYNC, OUTPUT_ORDERED, OUTPUT_QUIET };
+
+// Events per ring, a power of two.
+#define OUTPUT_RING_SIZE (1 << 14)
+
+struct out_event {
+  uint64_t clock;
+  uint64_t address;
+  int64_t value; // read, written, or found by an atomic
+  uint8_t type;  // enum inst_type
+};
+
+// Producer and consumer fields sit on separate host cache lines.
+struct out_ring {
+  _Alignas(64) atomic_size_t head; // next slot the core writes
+  size_t cached_tail;              // core's last view of tail
+  _Alignas(64) atomic_size_t tail; // next slot the writer reads
+  _Alignas(64) atomic_bool done;
+  struct out_event *events;
+};
+
+extern enum output_mode output_mode;
+extern struct out_ring *out_rings;
+
+// Start the writer thread for num_cores cores writing to out.
+void output_start(int num_cores, FILE *out);
+
+// The core will not produce any more events.
+void output_core_done(int core);
+
+// Wait for the writer to drain every ring.
+void output_finish(void);
+
+// Wait until the writer has freed space in a full ring.
+void output_wait_space(struct out_ring *r);
+
+// Record one instruction of core. Only ever called from that core's thread.
+static inline void output_event(int core, uint64_t clock, int type,
+                                uint64_t address, int64_t value) {
+  if (output_mode == OUTPUT_QUIET)
+    return;
+  struct out_ring *r = &out_rings[core];
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (head - r->cached_tail == OUTPUT_RING_SIZE)
+    output_wait_space(r);
+  struct out_event *e = &r->events[head & (OUTPUT_RING_SIZE - 1)];
+  e->clock = clock;
+  e->address = address;
+  e->type = type;
+  e->value = value;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+#endif
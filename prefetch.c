@@ -0,0 +1,103 @@
+/*
+ * Filename: prefetch.c
+ * Prefetcher training, see prefetch.h.
+ */
+#include "prefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int prefetch_degree[PREFETCHERS];
+bool prefetching;
+
+static const char *const prefetcher_names[PREFETCHERS] = {
+    [PF_NEXT] = "next", [PF_STRIDE] = "stride", [PF_STREAM] = "stream"};
+
+bool prefetch_parse(char *spec) {
+  for (char *item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+    char *colon = strchr(item, ':');
+    int degree = colon ? atoi(colon + 1) : 1;
+    if (colon)
+      *colon = '\0';
+    int pf = 0;
+    while (pf < PREFETCHERS && strcmp(item, prefetcher_names[pf]))
+      pf++;
+    if (pf == PREFETCHERS || degree < 1 || degree > PREFETCH_MAX_DEGREE)
+      return false;
+    prefetch_degree[pf] = degree;
+    prefetching = true;
+  }
+  return true;
+}
+
+// The blocks following block by step, degree of them.
+static int ahead(uint64_t block, int64_t step, int degree, uint64_t *out) {
+  for (int i = 1; i <= degree; i++)
+    out[i - 1] = block + step * i;
+  return degree;
+}
+
+static int train_stride(struct prefetch_state *p, uint64_t block,
+                        uint64_t *out) {
+  uint64_t region = block / PREFETCH_REGION;
+  struct stride_entry *e =
+      &p->stride[(region ^ region >> 8) % PREFETCH_STRIDE_ENTRIES];
+  if (e->region != region) {
+    *e = (struct stride_entry){region, block, 0, 0};
+    return 0;
+  }
+  int64_t stride = (int64_t)(block - e->last);
+  if (!stride)
+    return 0;
+  if (stride == e->stride) {
+    if (e->confidence < 2)
+      e->confidence++;
+  } else {
+    e->stride = stride;
+    e->confidence = 0;
+  }
+  e->last = block;
+  if (e->confidence < 2)
+    return 0;
+  return ahead(block, stride, prefetch_degree[PF_STRIDE], out);
+}
+
+static int train_stream(struct prefetch_state *p, uint64_t block,
+                        uint64_t *out) {
+  int degree = prefetch_degree[PF_STREAM];
+  struct stream *lru = &p->streams[0];
+  for (int i = 0; i < PREFETCH_STREAMS; i++) {
+    struct stream *s = &p->streams[i];
+    if (s->used < lru->used)
+      lru = s;
+    if (!s->used)
+      continue;
+    int64_t delta = (int64_t)(block - s->head);
+    if (!s->dir && (delta == 1 || delta == -1)) {
+      // a second miss next to the first sets the direction
+      s->dir = (int)delta;
+    } else if (!s->dir || delta * s->dir < 1 || delta * s->dir > degree) {
+      continue;
+    }
+    s->head = block;
+    s->used = p->accesses;
+    return ahead(block, s->dir, degree, out);
+  }
+  *lru = (struct stream){block, 0, p->accesses};
+  return 0;
+}
+
+int prefetch_train(struct prefetch_state *p, uint64_t block, bool trigger,
+                   uint64_t *out) {
+  int n = 0;
+  p->accesses++;
+  if (prefetch_degree[PF_STRIDE])
+    n += train_stride(p, block, out + n);
+  if (!trigger)
+    return n;
+  if (prefetch_degree[PF_NEXT])
+    n += ahead(block, 1, prefetch_degree[PF_NEXT], out + n);
+  if (prefetch_degree[PF_STREAM])
+    n += train_stream(p, block, out + n);
+  return n;
+}
@@ -0,0 +1,72 @@
+/*
+ * Filename: prefetch.h
+ * Hardware prefetchers issuing fills into each core's L1.
+ *
+ * Every core's prefetchers watch its demand accesses and propose lines to
+ * fetch ahead of them:
+ * - next: on a miss, the next degree lines.
+ * - stride: per region of PREFETCH_REGION lines, once the same stride
+ *   between accesses has been seen three times in a row (four accesses),
+ *   the next degree lines along it.
+ * - stream: up to PREFETCH_STREAMS ascending or descending runs of misses,
+ *   each kept degree lines ahead of its last access.
+ * A hit on a line that was prefetched and not yet used counts as a miss for
+ * training, so a prefetcher that is keeping up keeps running ahead.
+ *
+ * Prefetches are issued as INST_PREFETCH instructions (see trace.h) and
+ * prefetched lines are filled like read misses, with the same snooping and
+ * coherence states, so they take part in invalidations like any other line.
+ * Traces carry no program counters, so the stride table is indexed by
+ * region rather than by instruction, and streams are prefetched into the L1
+ * rather than into separate stream buffers.
+ */
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum prefetcher { PF_NEXT, PF_STRIDE, PF_STREAM, PREFETCHERS };
+
+#define PREFETCH_MAX_DEGREE 16
+#define PREFETCH_STRIDE_ENTRIES 16
+#define PREFETCH_REGION 64 // lines, a 4 KiB page of 64-byte lines
+#define PREFETCH_STREAMS 8
+// Lines proposed per access at most.
+#define PREFETCH_MAX (PREFETCHERS * PREFETCH_MAX_DEGREE)
+
+// Lines each prefetcher fetches ahead, 0 if it is off.
+extern int prefetch_degree[PREFETCHERS];
+extern bool prefetching; // any prefetcher is on
+
+struct stride_entry {
+  uint64_t region;
+  uint64_t last; // block of the last access
+  int64_t stride;
+  int confidence;
+};
+
+struct stream {
+  uint64_t head; // block of the last access
+  int dir;       // +1 or -1, 0 while only one miss has been seen
+  uint64_t used; // for replacement
+};
+
+// The prefetchers of one core.
+struct prefetch_state {
+  struct stride_entry stride[PREFETCH_STRIDE_ENTRIES];
+  struct stream streams[PREFETCH_STREAMS];
+  uint64_t accesses;
+};
+
+// Turn on the prefetchers in spec, "name[:degree],...". Returns false if spec
+// is invalid.
+bool prefetch_parse(char *spec);
+
+// Show core's demand access to block to its prefetchers. trigger is set if
+// the access missed or hit a prefetched line. Writes the blocks to prefetch
+// to out and returns how many.
+int prefetch_train(struct prefetch_state *p, uint64_t block, bool trigger,
+                   uint64_t *out);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Filename: replacement.c
+ * Policy names and metadata layout for replacement.h.
+ */
+#include "replacement.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *const repl_names[REPL_POLICIES] = {
+    [REPL_FIFO] = "fifo",   [REPL_LRU] = "lru",     [REPL_PLRU] = "plru",
+    [REPL_SRRIP] = "srrip", [REPL_BRRIP] = "brrip", [REPL_RANDOM] = "random",
+};
+
+int repl_parse(const char *name) {
+  for (int p = 0; p < REPL_POLICIES; p++) {
+    if (!strcmp(name, repl_names[p]))
+      return p;
+  }
+  return -1;
+}
+
+const char *repl_check(enum repl_policy policy, int ways) {
+  if (policy == REPL_LRU && ways > REPL_LRU_MAX_WAYS)
+    return "lru supports at most 256 ways";
+  if (policy == REPL_PLRU &&
+      (ways > REPL_PLRU_MAX_WAYS || (ways & (ways - 1))))
+    return "plru needs a power of two of at most 64 ways";
+  return NULL;
+}
+
+void repl_init(struct repl_state *r, struct arena *a, enum repl_policy policy,
+               int sets, int ways, uint64_t seed) {
+  size_t lines = (size_t)sets * ways;
+  r->set = (uint64_t *)arena_alloc(a, sizeof(uint64_t) * sets);
+  r->prev = r->next = r->rrpv = NULL;
+  // xorshift must not start at zero
+  r->rng = seed * 0x9e3779b97f4a7c15ULL | 1;
+
+  if (policy == REPL_LRU) {
+    r->prev = (uint8_t *)arena_alloc(a, lines);
+    r->next = (uint8_t *)arena_alloc(a, lines);
+    if (arena_sizing(a))
+      return;
+    // Start with the list 0, 1, ..., ways - 1.
+    for (size_t i = 0; i < lines; i++) {
+      int w = i % ways;
+      r->prev[i] = w - 1;
+      r->next[i] = w + 1;
+    }
+    for (int s = 0; s < sets; s++)
+      r->set[s] = (uint64_t)(ways - 1) << 8;
+  } else if (policy == REPL_SRRIP || policy == REPL_BRRIP) {
+    r->rrpv = (uint8_t *)arena_alloc(a, lines);
+    if (!arena_sizing(a))
+      memset(r->rrpv, RRPV_MAX, lines);
+  }
+}
+
+void repl_checkpoint(struct checkpoint *ck, struct repl_state *r, int sets,
+                     int ways) {
+  size_t lines = (size_t)sets * ways;
+  ckpt_bytes(ck, r->set, sizeof(uint64_t) * sets);
+  if (r->prev) {
+    ckpt_bytes(ck, r->prev, lines);
+    ckpt_bytes(ck, r->next, lines);
+  }
+  if (r->rrpv)
+    ckpt_bytes(ck, r->rrpv, lines);
+  ckpt_u64(ck, &r->rng);
+}
@@ -0,0 +1,197 @@
+/*
+ * Filename: replacement.h
+ * Replacement policies for set-associative caches.
+ *
+ * Each cache keeps the metadata of its policy next to its lines, and every
+ * update touches a fixed number of entries of one set:
+ * - REPL_FIFO: a per-set pointer to the oldest fill.
+ * - REPL_LRU: a doubly linked recency list threaded through per-line way
+ *   numbers, with its head (most recent) and tail in the set word. A hit
+ *   moves one entry to the front, the victim is the tail.
+ * - REPL_PLRU: tree pseudo-LRU, ways - 1 tree bits in the set word, each
+ *   pointing away from the most recently used half below it.
+ * - REPL_SRRIP, REPL_BRRIP: 2-bit re-reference prediction values per line.
+ *   SRRIP inserts with a long prediction, BRRIP mostly with a distant one.
+ * - REPL_RANDOM: a per-cache xorshift generator.
+ *
+ * Invalid ways are always filled first, the policy only picks among valid
+ * lines. The functions below are meant to be inlined with constant `ways` and
+ * `policy`, so the policy costs no dispatch on the access path.
+ */
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "checkpoint.h"
+
+enum repl_policy {
+  REPL_FIFO,
+  REPL_LRU,
+  REPL_PLRU,
+  REPL_SRRIP,
+  REPL_BRRIP,
+  REPL_RANDOM,
+  REPL_POLICIES
+};
+
+// Largest associativity LRU and PLRU support.
+#define REPL_LRU_MAX_WAYS 256
+#define REPL_PLRU_MAX_WAYS 64
+
+#define RRPV_MAX 3
+// One BRRIP fill in BRRIP_LONG_ODDS is inserted like SRRIP does.
+#define BRRIP_LONG_ODDS 32
+
+struct repl_state {
+  uint64_t *set;         // per set: FIFO pointer, PLRU bits or LRU head/tail
+  uint8_t *prev, *next;  // per line: LRU neighbours, as ways of the set
+  uint8_t *rrpv;         // per line: RRIP prediction
+  uint64_t rng;          // REPL_RANDOM and REPL_BRRIP
+};
+
+extern const char *const repl_names[REPL_POLICIES];
+
+// Policy called name, or -1.
+int repl_parse(const char *name);
+
+// NULL if the policy supports the associativity, otherwise why not.
+const char *repl_check(enum repl_policy policy, int ways);
+
+// Carve the metadata of a cache from a and set it up.
+void repl_init(struct repl_state *r, struct arena *a, enum repl_policy policy,
+               int sets, int ways, uint64_t seed);
+
+// Save or restore the metadata of a cache of sets sets of ways ways.
+void repl_checkpoint(struct checkpoint *ck, struct repl_state *r, int sets,
+                     int ways);
+
+static inline __attribute__((always_inline)) uint64_t
+repl_random(struct repl_state *r) {
+  uint64_t x = r->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return r->rng = x;
+}
+
+// Move way to the front of the recency list of the set starting at base.
+static inline __attribute__((always_inline)) void
+lru_touch(struct repl_state *r, int set, size_t base, int way) {
+  uint64_t ends = r->set[set];
+  int head = ends & 0xff, tail = ends >> 8;
+  if (way == head)
+    return;
+  int p = r->prev[base + way], n = r->next[base + way];
+  r->next[base + p] = n;
+  if (way == tail)
+    tail = p;
+  else
+    r->prev[base + n] = p;
+  r->next[base + way] = head;
+  r->prev[base + head] = way;
+  r->set[set] = way | tail << 8;
+}
+
+// Point every tree node above way away from it.
+static inline __attribute__((always_inline)) void
+plru_touch(struct repl_state *r, int set, int way, const int ways) {
+  uint64_t bits = r->set[set];
+  int node = 1;
+#pragma GCC unroll 6
+  for (int half = ways / 2; half; half /= 2) {
+    int right = (way & half) != 0;
+    bits = right ? bits & ~(1ULL << node) : bits | 1ULL << node;
+    node = 2 * node + right;
+  }
+  r->set[set] = bits;
+}
+
+// Bump every prediction of the set until one is distant, and return that way.
+static inline __attribute__((always_inline)) int
+rrip_victim(struct repl_state *r, size_t base, const int ways) {
+  uint8_t *rrpv = r->rrpv + base;
+  int oldest = 0;
+#pragma GCC unroll 16
+  for (int w = 1; w < ways; w++) {
+    if (rrpv[w] > rrpv[oldest])
+      oldest = w;
+  }
+  int age = RRPV_MAX - rrpv[oldest];
+  if (age) {
+#pragma GCC unroll 16
+    for (int w = 0; w < ways; w++)
+      rrpv[w] += age;
+  }
+  return oldest;
+}
+
+// Update the policy for a hit on way.
+static inline __attribute__((always_inline)) void
+repl_hit(struct repl_state *r, int set, size_t base, int way, const int ways,
+         const enum repl_policy policy) {
+  switch (policy) {
+  case REPL_LRU:
+    lru_touch(r, set, base, way);
+    break;
+  case REPL_PLRU:
+    plru_touch(r, set, way, ways);
+    break;
+  case REPL_SRRIP:
+  case REPL_BRRIP:
+    r->rrpv[base + way] = 0;
+    break;
+  default:
+    break;
+  }
+}
+
+// Update the policy for a new line in way.
+static inline __attribute__((always_inline)) void
+repl_fill(struct repl_state *r, int set, size_t base, int way,
+          const int ways, const enum repl_policy policy) {
+  switch (policy) {
+  case REPL_SRRIP:
+    r->rrpv[base + way] = RRPV_MAX - 1;
+    break;
+  case REPL_BRRIP:
+    r->rrpv[base + way] =
+        repl_random(r) % BRRIP_LONG_ODDS ? RRPV_MAX : RRPV_MAX - 1;
+    break;
+  default:
+    repl_hit(r, set, base, way, ways, policy);
+    break;
+  }
+}
+
+// Way of a full set to replace.
+static inline __attribute__((always_inline)) int
+repl_victim(struct repl_state *r, int set, size_t base, const int ways,
+            const enum repl_policy policy) {
+  switch (policy) {
+  case REPL_FIFO: {
+    int w = r->set[set];
+    r->set[set] = w + 1 == ways ? 0 : w + 1;
+    return w;
+  }
+  case REPL_LRU:
+    return r->set[set] >> 8;
+  case REPL_PLRU: {
+    uint64_t bits = r->set[set];
+    int node = 1;
+#pragma GCC unroll 6
+    for (int half = ways / 2; half; half /= 2)
+      node = 2 * node + (int)(bits >> node & 1);
+    return node - ways;
+  }
+  case REPL_SRRIP:
+  case REPL_BRRIP:
+    return rrip_victim(r, base, ways);
+  default:
+    return (repl_random(r) >> 32) % ways;
+  }
+}
+
+#endif
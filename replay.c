@@ -0,0 +1,149 @@
+/*
+ * Filename: replay.c
+ * Access order logs, see replay.h.
+ */
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+enum replay_mode replay_mode = REPLAY_OFF;
+struct replay_log *replay_logs;
+
+static int num_stripes, num_cores;
+
+static void backoff(int *idle) {
+  if (++*idle < 64) {
+    thrd_yield();
+  } else {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 50000};
+    thrd_sleep(&ts, NULL);
+  }
+}
+
+static bool read_all(FILE *f, void *p, size_t len) {
+  return fread(p, 1, len, f) == len;
+}
+
+// Load the recording at path, which must be for stripes stripes and cores
+// cores.
+static bool load(const char *path, int stripes, int cores) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char magic[4];
+  uint32_t shape[2];
+  bool ok = read_all(f, magic, sizeof(magic)) &&
+            !memcmp(magic, REPLAY_MAGIC, sizeof(magic)) &&
+            read_all(f, shape, sizeof(shape));
+  if (ok && (shape[0] != (uint32_t)stripes || shape[1] != (uint32_t)cores)) {
+    fprintf(stderr,
+            "%s: recorded with %u lock stripes and %u cores, not %d and %d\n",
+            path, shape[0], shape[1], stripes, cores);
+    fclose(f);
+    return false;
+  }
+  for (int s = 0; ok && s < stripes; s++) {
+    struct replay_log *log = &replay_logs[s];
+    uint64_t len;
+    ok = read_all(f, &len, sizeof(len));
+    if (!ok)
+      break;
+    log->len = log->cap = len;
+    log->runs = (struct replay_run *)malloc(sizeof(struct replay_run) * len);
+    ok = read_all(f, log->runs, sizeof(struct replay_run) * len);
+  }
+  if (!ok)
+    fprintf(stderr, "%s: not a complete recording\n", path);
+  fclose(f);
+  return ok;
+}
+
+bool replay_start(enum replay_mode mode, int stripes, int cores,
+                  const char *path) {
+  replay_mode = mode;
+  num_stripes = stripes;
+  num_cores = cores;
+  replay_logs = (struct replay_log *)aligned_alloc(
+      _Alignof(struct replay_log), sizeof(struct replay_log) * stripes);
+  for (int s = 0; s < stripes; s++) {
+    atomic_init(&replay_logs[s].pos, 0);
+    replay_logs[s].used = 0;
+    replay_logs[s].len = replay_logs[s].cap = 0;
+    replay_logs[s].runs = NULL;
+  }
+  return mode != REPLAY_REPLAY || load(path, stripes, cores);
+}
+
+void replay_wait(int stripe, int core) {
+  struct replay_log *log = &replay_logs[stripe];
+  int idle = 0;
+  for (;;) {
+    size_t pos = atomic_load_explicit(&log->pos, memory_order_acquire);
+    if (pos == log->len) {
+      fprintf(stderr, "replay: core %d accesses lock stripe %d beyond the "
+                      "recording\n", core, stripe);
+      exit(EXIT_FAILURE);
+    }
+    if (log->runs[pos].core == (uint32_t)core)
+      return;
+    backoff(&idle);
+  }
+}
+
+void replay_access(int stripe, int core) {
+  struct replay_log *log = &replay_logs[stripe];
+  if (replay_mode == REPLAY_REPLAY) {
+    size_t pos = atomic_load_explicit(&log->pos, memory_order_relaxed);
+    if (++log->used == log->runs[pos].accesses) {
+      log->used = 0;
+      atomic_store_explicit(&log->pos, pos + 1, memory_order_release);
+    }
+    return;
+  }
+  struct replay_run *last = log->len ? &log->runs[log->len - 1] : NULL;
+  if (last && last->core == (uint32_t)core && last->accesses < UINT32_MAX) {
+    last->accesses++;
+    return;
+  }
+  if (log->len == log->cap) {
+    log->cap = log->cap ? log->cap * 2 : 64;
+    log->runs = (struct replay_run *)realloc(
+        log->runs, sizeof(struct replay_run) * log->cap);
+  }
+  log->runs[log->len++] = (struct replay_run){(uint32_t)core, 1};
+}
+
+bool replay_finish(const char *path) {
+  bool ok = true;
+  if (replay_mode == REPLAY_RECORD) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+      perror(path);
+      ok = false;
+    } else {
+      uint32_t shape[2] = {num_stripes, num_cores};
+      fwrite(REPLAY_MAGIC, 1, 4, f);
+      fwrite(shape, sizeof(shape), 1, f);
+      for (int s = 0; s < num_stripes; s++) {
+        uint64_t len = replay_logs[s].len;
+        fwrite(&len, sizeof(len), 1, f);
+        fwrite(replay_logs[s].runs, sizeof(struct replay_run), len, f);
+      }
+      if (ferror(f) | fclose(f)) {
+        perror(path);
+        ok = false;
+      }
+    }
+  }
+  for (int s = 0; s < num_stripes; s++)
+    free(replay_logs[s].runs);
+  free(replay_logs);
+  replay_mode = REPLAY_OFF;
+  return ok;
+}
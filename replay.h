@@ -0,0 +1,59 @@
+/*
+ * Filename: replay.h
+ * Recording and replaying the order in which cores access each set.
+ *
+ * Cores interact only through the sets they share, and every access to a set
+ * happens under the set's lock, so the order of accesses to each lock stripe
+ * decides the whole run. Recording logs that order per stripe, run-length
+ * encoded as (core, accesses) pairs. Replaying makes each core wait until the
+ * log says it is its turn at the stripe, which reproduces the recorded run's
+ * statistics and per-core values exactly.
+ *
+ * Replaying needs every core on its own host thread, as a core waiting for
+ * its turn would otherwise block the cores it waits for.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum replay_mode { REPLAY_OFF, REPLAY_RECORD, REPLAY_REPLAY };
+
+#define REPLAY_MAGIC "CSRP"
+
+struct replay_run {
+  uint32_t core;
+  uint32_t accesses;
+};
+
+// The log of one stripe. Only touched under the stripe's lock, except pos,
+// which replaying cores poll for their turn.
+struct replay_log {
+  _Alignas(64) atomic_size_t pos; // current run
+  uint32_t used;                  // accesses made of the current run
+  size_t len, cap;
+  struct replay_run *runs;
+};
+
+extern enum replay_mode replay_mode;
+extern struct replay_log *replay_logs;
+
+// Record the order of stripes stripes, or load the recording at path to
+// replay it. Returns false (with a message on stderr) if it can't be loaded.
+bool replay_start(enum replay_mode mode, int stripes, int cores,
+                  const char *path);
+
+// Wait until it is core's turn at stripe. Exits if the run has diverged from
+// the recording.
+void replay_wait(int stripe, int core);
+
+// Under the stripe lock: count the access of core.
+void replay_access(int stripe, int core);
+
+// Write the recording to path. Returns false on I/O error.
+bool replay_finish(const char *path);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Filename: sparse_mem.c
+ * Sparse tables and the simulated main memory, see sparse_mem.h.
+ */
+#include "sparse_mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Each radix tree node holds 2^RADIX_BITS child pointers.
+#define RADIX_BITS 13
+#define RADIX_ENTRIES (1 << RADIX_BITS)
+
+void sparse_init(sparse *s, size_t elem_size) {
+  s->elem_size = elem_size;
+  s->page_shift = __builtin_ctzll(SPARSE_PAGE_BYTES / elem_size);
+  s->levels = (64 - s->page_shift + RADIX_BITS - 1) / RADIX_BITS;
+  s->root = (_Atomic(void *) *)calloc(RADIX_ENTRIES, sizeof(void *));
+  atomic_init(&s->pages, 0);
+}
+
+// Load a child, allocating it if asked to. Concurrent creators race with a
+// CAS and the loser frees its copy. The winner gets *created set.
+static void *child(_Atomic(void *) *slot, size_t size, bool create,
+                   bool *created) {
+  void *node = atomic_load_explicit(slot, memory_order_acquire);
+  if (node || !create)
+    return node;
+  void *fresh = calloc(1, size);
+  if (atomic_compare_exchange_strong_explicit(slot, &node, fresh,
+                                              memory_order_acq_rel,
+                                              memory_order_acquire)) {
+    *created = true;
+    return fresh;
+  }
+  free(fresh);
+  return node;
+}
+
+void *sparse_get(sparse *s, uint64_t index, bool create) {
+  uint64_t page = index >> s->page_shift;
+  _Atomic(void *) *node = s->root;
+  bool created = false;
+  for (int level = s->levels - 1; level > 0; level--) {
+    node = (_Atomic(void *) *)child(
+        &node[(page >> (level * RADIX_BITS)) & (RADIX_ENTRIES - 1)],
+        RADIX_ENTRIES * sizeof(void *), create, &created);
+    if (!node)
+      return NULL;
+  }
+  created = false;
+  byte *data = (byte *)child(&node[page & (RADIX_ENTRIES - 1)],
+                             SPARSE_PAGE_BYTES, create, &created);
+  if (!data)
+    return NULL;
+  if (created)
+    atomic_fetch_add_explicit(&s->pages, 1, memory_order_relaxed);
+  uint64_t elem = index & ((1ULL << s->page_shift) - 1);
+  return data + elem * s->elem_size;
+}
+
+static void free_node(_Atomic(void *) *node, int level) {
+  for (int i = 0; i < RADIX_ENTRIES; i++) {
+    void *next = atomic_load_explicit(&node[i], memory_order_relaxed);
+    if (next && level > 0)
+      free_node((_Atomic(void *) *)next, level - 1);
+    else
+      free(next);
+  }
+  free(node);
+}
+
+void sparse_free(sparse *s) {
+  free_node(s->root, s->levels - 1);
+  s->root = NULL;
+}
+
+// Save every page below node, the tree level-th above the pages, preceded by
+// its page number. first is the page number of the node's first page.
+static void save_node(struct checkpoint *ck, _Atomic(void *) *node,
+                      int level, uint64_t first) {
+  for (uint64_t i = 0; i < RADIX_ENTRIES; i++) {
+    void *next = atomic_load_explicit(&node[i], memory_order_relaxed);
+    uint64_t page = first | i << (level * RADIX_BITS);
+    if (!next)
+      continue;
+    if (level > 0) {
+      save_node(ck, (_Atomic(void *) *)next, level - 1, page);
+    } else {
+      ckpt_u64(ck, &page);
+      ckpt_bytes(ck, next, SPARSE_PAGE_BYTES);
+    }
+  }
+}
+
+void sparse_checkpoint(struct checkpoint *ck, sparse *s) {
+  uint64_t pages = atomic_load(&s->pages);
+  ckpt_u64(ck, &pages);
+  if (!ck->restore) {
+    save_node(ck, s->root, s->levels - 1, 0);
+    return;
+  }
+  for (uint64_t i = 0; i < pages && ck->ok; i++) {
+    uint64_t page = 0;
+    ckpt_u64(ck, &page);
+    if (ck->ok)
+      ckpt_bytes(ck, sparse_get(s, page << s->page_shift, true),
+                 SPARSE_PAGE_BYTES);
+  }
+}
+
+static sparse memory;
+
+void mem_init(void) { sparse_init(&memory, 1); }
+
+void mem_read(uint64_t address, byte *dst, size_t len) {
+  while (len) {
+    size_t in_page = SPARSE_PAGE_BYTES - address % SPARSE_PAGE_BYTES;
+    size_t n = len < in_page ? len : in_page;
+    const byte *src = (const byte *)sparse_get(&memory, address, false);
+    if (src)
+      memcpy(dst, src, n);
+    else
+      memset(dst, 0, n);
+    address += n;
+    dst += n;
+    len -= n;
+  }
+}
+
+void mem_write(uint64_t address, const byte *src, size_t len) {
+  while (len) {
+    size_t in_page = SPARSE_PAGE_BYTES - address % SPARSE_PAGE_BYTES;
+    size_t n = len < in_page ? len : in_page;
+    memcpy(sparse_get(&memory, address, true), src, n);
+    address += n;
+    src += n;
+    len -= n;
+  }
+}
+
+size_t mem_footprint(void) {
+  return atomic_load(&memory.pages) * SPARSE_PAGE_BYTES;
+}
+
+void mem_checkpoint(struct checkpoint *ck) { sparse_checkpoint(ck, &memory); }
+
+void mem_free(void) { sparse_free(&memory); }
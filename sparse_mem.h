@@ -0,0 +1,58 @@
+/*
+ * Filename: sparse_mem.h
+ * Sparse storage for the simulated 64-bit address space.
+ *
+ * A sparse table is an array indexed by a full 64-bit index whose pages are
+ * only allocated once something is stored in them, so its footprint follows
+ * the working set rather than the index range. Pages hang off a radix tree
+ * whose nodes are installed with compare-and-swap, so any number of threads
+ * may look up and materialize pages concurrently; the caller is responsible
+ * for synchronizing access to the elements themselves.
+ *
+ * The simulated main memory is a sparse table of bytes. Reads of pages that
+ * were never written return zeros without allocating anything.
+ */
+#ifndef SPARSE_MEM_H
+#define SPARSE_MEM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "checkpoint.h"
+#include "trace.h"
+
+// Bytes per page of a sparse table.
+#define SPARSE_PAGE_BYTES 4096
+
+struct sparse {
+  size_t elem_size; // power of two, at most SPARSE_PAGE_BYTES
+  int page_shift;   // log2 of elements per page
+  int levels;       // radix tree depth above the pages
+  _Atomic(void *) *root;
+  atomic_size_t pages; // materialized pages
+};
+typedef struct sparse sparse;
+
+void sparse_init(sparse *s, size_t elem_size);
+
+// Pointer to element index, or NULL if its page doesn't exist and create is
+// false. Newly created pages are zeroed.
+void *sparse_get(sparse *s, uint64_t index, bool create);
+
+void sparse_free(sparse *s);
+
+// Save the materialized pages of s, or restore them into an empty s.
+void sparse_checkpoint(struct checkpoint *ck, sparse *s);
+
+// Simulated main memory.
+void mem_init(void);
+void mem_read(uint64_t address, byte *dst, size_t len);
+void mem_write(uint64_t address, const byte *src, size_t len);
+// Bytes of host memory backing the simulated memory.
+size_t mem_footprint(void);
+void mem_checkpoint(struct checkpoint *ck);
+void mem_free(void);
+
+#endif
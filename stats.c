@@ -0,0 +1,280 @@
+/*
+ * Filename: stats.c
+ * Aggregation and export of the counters in stats.h.
+ */
+#include "stats.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+core_stats **stats;
+
+static int stats_cores;
+
+static const char *const counter_names[] = {
+#define STATS_NAME(name) #name,
+    STATS_COUNTERS(STATS_NAME)
+#undef STATS_NAME
+};
+
+#define NUM_COUNTERS (sizeof(counter_names) / sizeof(counter_names[0]))
+
+// Every value of core_stats: the counters, the latency buckets, then the
+// traffic per memory controller and per link.
+#define NUMA_VALUES (NUMA_MAX_SOCKETS * (2 + NUMA_MAX_SOCKETS))
+#define NUM_VALUES (NUM_COUNTERS + LATENCY_BUCKETS + NUMA_VALUES)
+
+// Buckets are exported as latency_<fewest cycles in the bucket>, memory
+// controllers as mem_reads_<socket> and mem_writes_<socket>, and links as
+// link_<from>_<to>.
+static char extra_names[NUM_VALUES - NUM_COUNTERS][24];
+
+// The samples of one core: per value the sums of its squares and of its
+// products with the sample's instruction count. The sums of the values are
+// the core's counters themselves.
+struct sample_state {
+  core_stats start; // counters when the open window started
+  bool open;
+  uint64_t samples;
+  double insts_sq; // sum of the squared instructions per sample
+  double sq[NUM_VALUES];
+  double cross[NUM_VALUES];
+} __attribute__((aligned(64)));
+
+// NULL unless the run is sampled.
+static struct sample_state *samples;
+
+// Estimated totals and the half widths of their confidence intervals (NAN
+// if a core has fewer than two samples), once the run is finished.
+static double estimate[NUM_VALUES], ci95[NUM_VALUES];
+
+static const char *value_name(size_t k) {
+  return k < NUM_COUNTERS ? counter_names[k] : extra_names[k - NUM_COUNTERS];
+}
+
+// The values of s as an array in export order.
+static const uint64_t *counters(const core_stats *s) {
+  return (const uint64_t *)s;
+}
+
+void stats_init(int num_cores, core_stats **per_core) {
+  stats_cores = num_cores;
+  stats = per_core;
+  char(*name)[24] = extra_names;
+  for (int b = 0; b < LATENCY_BUCKETS; b++) {
+    snprintf(*name++, sizeof(*name), "latency_%llu",
+             b ? 1ULL << (b - 1) : 0ULL);
+  }
+  for (int s = 0; s < NUMA_MAX_SOCKETS; s++)
+    snprintf(*name++, sizeof(*name), "mem_reads_%d", s);
+  for (int s = 0; s < NUMA_MAX_SOCKETS; s++)
+    snprintf(*name++, sizeof(*name), "mem_writes_%d", s);
+  for (int from = 0; from < NUMA_MAX_SOCKETS; from++) {
+    for (int to = 0; to < NUMA_MAX_SOCKETS; to++)
+      snprintf(*name++, sizeof(*name), "link_%d_%d", from, to);
+  }
+}
+
+void stats_sample_init(int num_cores) {
+  samples = (struct sample_state *)aligned_alloc(
+      _Alignof(struct sample_state), sizeof(struct sample_state) * num_cores);
+  memset(samples, 0, sizeof(struct sample_state) * num_cores);
+}
+
+void stats_sample_begin(int core) {
+  samples[core].start = *stats[core];
+  samples[core].open = true;
+}
+
+void stats_sample_end(int core) {
+  struct sample_state *s = &samples[core];
+  if (!s->open)
+    return;
+  s->open = false;
+  const uint64_t *now = counters(stats[core]), *start = counters(&s->start);
+  double insts = (double)stats_insts(stats[core]) -
+                 (double)stats_insts(&s->start);
+  if (!insts)
+    return;
+  s->samples++;
+  s->insts_sq += insts * insts;
+  for (size_t k = 0; k < NUM_VALUES; k++) {
+    double x = (double)(now[k] - start[k]);
+    s->sq[k] += x * x;
+    s->cross[k] += x * insts;
+  }
+}
+
+void stats_sample_finish(const uint64_t *insts) {
+  for (size_t k = 0; k < NUM_VALUES; k++)
+    estimate[k] = ci95[k] = 0;
+  for (int i = 0; i < stats_cores; i++) {
+    struct sample_state *s = &samples[i];
+    stats_sample_end(i);
+    double n = s->samples;
+    double measured = (double)stats_insts(stats[i]);
+    if (!measured)
+      continue;
+    // Finite population correction: the samples cover part of the trace.
+    double fpc = 1 - measured / insts[i];
+    if (fpc < 0)
+      fpc = 0;
+    for (size_t k = 0; k < NUM_VALUES; k++) {
+      double x = (double)counters(stats[i])[k], rate = x / measured;
+      estimate[k] += rate * insts[i];
+      if (n < 2) {
+        ci95[k] = NAN;
+        continue;
+      }
+      // Residual variance of the samples around rate * instructions.
+      double var = (s->sq[k] - 2 * rate * s->cross[k] +
+                    rate * rate * s->insts_sq) /
+                   (n - 1);
+      double mean_insts = measured / n;
+      ci95[k] += (double)insts[i] * insts[i] * (var > 0 ? var : 0) * fpc /
+                 (n * mean_insts * mean_insts);
+    }
+  }
+  for (size_t k = 0; k < NUM_VALUES; k++)
+    ci95[k] = 1.96 * sqrt(ci95[k]);
+}
+
+void stats_sample_checkpoint(struct checkpoint *ck) {
+  ckpt_bytes(ck, samples, sizeof(struct sample_state) * stats_cores);
+}
+
+core_stats stats_total(void) {
+  core_stats total;
+  memset(&total, 0, sizeof(total));
+  uint64_t *sum = (uint64_t *)&total;
+  for (int i = 0; i < stats_cores; i++) {
+    for (size_t k = 0; k < NUM_VALUES; k++)
+      sum[k] += counters(stats[i])[k];
+  }
+  return total;
+}
+
+void stats_print(FILE *out) {
+  core_stats total = stats_total();
+  fprintf(out, "%-18s", "");
+  for (int i = 0; i < stats_cores; i++) {
+    char label[16];
+    snprintf(label, sizeof(label), "core %d", i);
+    fprintf(out, " %14s", label);
+  }
+  fprintf(out, " %14s\n", "total");
+  for (size_t k = 0; k < NUM_VALUES; k++) {
+    if (k >= NUM_COUNTERS && !counters(&total)[k])
+      continue;
+    fprintf(out, "%-18s", value_name(k));
+    for (int i = 0; i < stats_cores; i++)
+      fprintf(out, " %14" PRIu64, counters(stats[i])[k]);
+    fprintf(out, " %14" PRIu64 "\n", counters(&total)[k]);
+  }
+  if (!samples)
+    return;
+  uint64_t taken = 0;
+  for (int i = 0; i < stats_cores; i++)
+    taken += samples[i].samples;
+  fprintf(out, "\nestimated totals from %" PRIu64 " samples\n", taken);
+  fprintf(out, "%-18s %14s %14s\n", "", "estimate", "95% ci");
+  for (size_t k = 0; k < NUM_VALUES; k++) {
+    if (k >= NUM_COUNTERS && !counters(&total)[k])
+      continue;
+    fprintf(out, "%-18s %14.0f", value_name(k), estimate[k]);
+    if (isnan(ci95[k]))
+      fprintf(out, " %14s\n", "-");
+    else
+      fprintf(out, " %14.0f %7.2f%%\n", ci95[k],
+              estimate[k] ? 100 * ci95[k] / estimate[k] : 0);
+  }
+}
+
+static void json_estimates(FILE *out, const double *v) {
+  for (size_t k = 0; k < NUM_VALUES; k++) {
+    fprintf(out, "%s\"%s\": ", k ? ", " : "", value_name(k));
+    if (isnan(v[k]))
+      fprintf(out, "null");
+    else
+      fprintf(out, "%.0f", v[k]);
+  }
+}
+
+static void json_counters(FILE *out, const core_stats *s) {
+  for (size_t k = 0; k < NUM_VALUES; k++) {
+    fprintf(out, "%s\"%s\": %" PRIu64, k ? ", " : "", value_name(k),
+            counters(s)[k]);
+  }
+}
+
+static void export_json(FILE *out) {
+  fprintf(out, "{\n  \"cores\": [\n");
+  for (int i = 0; i < stats_cores; i++) {
+    fprintf(out, "    {\"core\": %d, ", i);
+    json_counters(out, stats[i]);
+    fprintf(out, "}%s\n", i + 1 < stats_cores ? "," : "");
+  }
+  core_stats total = stats_total();
+  fprintf(out, "  ],\n  \"total\": {");
+  json_counters(out, &total);
+  if (samples) {
+    fprintf(out, "},\n  \"estimate\": {");
+    json_estimates(out, estimate);
+    fprintf(out, "},\n  \"ci95\": {");
+    json_estimates(out, ci95);
+  }
+  fprintf(out, "}\n}\n");
+}
+
+static void csv_row(FILE *out, const core_stats *s) {
+  for (size_t k = 0; k < NUM_VALUES; k++)
+    fprintf(out, ",%" PRIu64, counters(s)[k]);
+  fprintf(out, "\n");
+}
+
+static void export_csv(FILE *out) {
+  fprintf(out, "core");
+  for (size_t k = 0; k < NUM_VALUES; k++)
+    fprintf(out, ",%s", value_name(k));
+  fprintf(out, "\n");
+  for (int i = 0; i < stats_cores; i++) {
+    fprintf(out, "%d", i);
+    csv_row(out, stats[i]);
+  }
+  core_stats total = stats_total();
+  fprintf(out, "total");
+  csv_row(out, &total);
+  if (samples) {
+    fprintf(out, "estimate");
+    for (size_t k = 0; k < NUM_VALUES; k++)
+      fprintf(out, ",%.0f", estimate[k]);
+    fprintf(out, "\nci95");
+    for (size_t k = 0; k < NUM_VALUES; k++) {
+      if (isnan(ci95[k]))
+        fprintf(out, ",");
+      else
+        fprintf(out, ",%.0f", ci95[k]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+bool stats_export(const char *path) {
+  if (!strcmp(path, "-")) {
+    export_json(stdout);
+    return true;
+  }
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  size_t len = strlen(path);
+  if (len >= 4 && !strcmp(path + len - 4, ".csv"))
+    export_csv(out);
+  else
+    export_json(out);
+  return !fclose(out);
+}
@@ -0,0 +1,133 @@
+/*
+ * Filename: stats.h
+ * Per-core cache and coherence statistics.
+ *
+ * Every counter is only ever updated by the core it belongs to, and each
+ * core's counters fill whole host cache lines, so counting needs neither
+ * atomics nor locks and never bounces a line between host cores. The totals
+ * are summed once the cores have finished.
+ *
+ * Besides the event counters every core keeps its simulated cycles and a
+ * histogram of access latencies in power of two buckets: bucket 0 counts
+ * accesses taking 0 cycles, bucket b > 0 those taking 2^(b-1) to 2^b - 1.
+ * On several sockets it also counts what its accesses cost each memory
+ * controller and each link between two sockets.
+ *
+ * In a sampled run the counters only cover the sample windows. Each window
+ * is one sample of every counter, and the totals over all instructions are
+ * estimated from the counts per instruction (a ratio estimator, per core),
+ * with 95% confidence intervals from the spread between the samples.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "checkpoint.h"
+#include "numa.h"
+
+// Every counter, in export order. Events caused in another core's cache
+// (invalidations, snoops) are counted by the core that caused them.
+#define STATS_COUNTERS(X)                                                      \
+  X(cycles)             /* simulated cycles spent on accesses */               \
+  X(reads)              /* RD instructions */                                  \
+  X(writes)             /* WR instructions */                                  \
+  X(atomics)            /* CAS and FAA instructions */                         \
+  X(cas_failures)       /* CAS that found another value and stored nothing */  \
+  X(fences)             /* FENCE instructions */                               \
+  X(split_accesses)     /* accesses straddling lines, run as one per line */   \
+  X(read_hits)          /* reads of a valid line */                            \
+  X(read_misses)        /* reads that had to fetch the line */                 \
+  X(write_hits)         /* writes and atomics to a valid line */               \
+  X(write_misses)       /* writes and atomics that had to fetch the line */    \
+  X(upgrades)           /* write hits that had to invalidate other copies */   \
+  X(evictions)          /* valid lines replaced */                             \
+  X(writebacks)         /* lines written back to memory */                     \
+  X(c2c_transfers)      /* lines filled from another core's cache */           \
+  X(l2_hits)            /* L1 fills served by the core's L2 */                 \
+  X(l2_misses)          /* L1 fills the L2 couldn't serve */                   \
+  X(llc_hits)           /* L2 (or L1) fills served by the LLC */               \
+  X(llc_misses)         /* fills the LLC couldn't serve */                     \
+  X(mem_fills)          /* lines filled from memory */                         \
+  X(invalidations)      /* lines invalidated in other caches */                \
+  X(snoops)             /* lookups in another core's cache */                  \
+  X(snoops_filtered)    /* misses the inclusive LLC kept from snooping */      \
+  X(back_invalidations) /* lines dropped to keep a lower level inclusive */ \
+  X(prefetches)         /* lines filled by a prefetcher */                     \
+  X(prefetch_hits)      /* prefetches of lines already in the L1 */            \
+  X(prefetch_useful)    /* prefetched lines a demand access then hit */        \
+  X(prefetch_unused)    /* prefetched lines evicted before any use */          \
+  X(prefetch_killed)    /* unused prefetched lines another core invalidated */ \
+  X(sb_coalesced)       /* stores merged into a buffered store to the line */  \
+  X(sb_forwards)        /* reads served from the core's store buffer */        \
+  X(sb_stall_cycles)    /* cycles waiting for the store buffer */              \
+  X(remote_fills)       /* LLC or memory fills from another socket's home */   \
+  X(remote_transfers)   /* lines supplied by a core on another socket */       \
+  X(remote_invalidated) /* copies invalidated on another socket */             \
+  X(remote_writebacks)  /* write-backs to another socket's home */             \
+  X(link_messages)      /* messages between sockets */                         \
+  X(link_bytes)         /* bytes of those messages */
+
+// The last bucket also counts every longer access.
+#define LATENCY_BUCKETS 24
+
+struct core_stats {
+#define STATS_FIELD(name) uint64_t name;
+  STATS_COUNTERS(STATS_FIELD)
+#undef STATS_FIELD
+  uint64_t latency[LATENCY_BUCKETS];
+  // Per socket with more than one, see numa.h: the lines its memory
+  // controller read and wrote, and the bytes it sent each other socket.
+  uint64_t mem_reads[NUMA_MAX_SOCKETS];
+  uint64_t mem_writes[NUMA_MAX_SOCKETS];
+  uint64_t link[NUMA_MAX_SOCKETS][NUMA_MAX_SOCKETS];
+} __attribute__((aligned(64)));
+typedef struct core_stats core_stats;
+
+// stats[core] points to the counters of core, which sit with the rest of the
+// core's state (see cpu_loop).
+extern core_stats **stats;
+
+// Count an access that took cycles.
+static inline void stats_latency(core_stats *st, uint64_t cycles) {
+  int b = cycles ? 64 - __builtin_clzll(cycles) : 0;
+  st->latency[b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1]++;
+}
+
+// Instructions counted in st.
+static inline uint64_t stats_insts(const core_stats *st) {
+  return st->reads + st->writes + st->atomics + st->fences;
+}
+
+// Use the zeroed counters per_core[core] of num_cores cores.
+void stats_init(int num_cores, core_stats **per_core);
+
+// Sum of the counters of every core.
+core_stats stats_total(void);
+
+// Print a table of every counter per core and in total, followed by the
+// latency buckets and socket traffic that aren't empty, and the estimates of
+// a sampled run.
+void stats_print(FILE *out);
+
+// Start collecting samples of num_cores cores.
+void stats_sample_init(int num_cores);
+
+// Open a sample window of core, or close the open one. Only core calls these.
+void stats_sample_begin(int core);
+void stats_sample_end(int core);
+
+// Close the open windows and estimate the totals over insts[core]
+// instructions of each core, for stats_print() and stats_export().
+void stats_sample_finish(const uint64_t *insts);
+
+// Save or restore the samples taken so far.
+void stats_sample_checkpoint(struct checkpoint *ck);
+
+// Export the counters to path as CSV if it ends in ".csv", otherwise as JSON.
+// "-" writes JSON to stdout. Returns false if the file can't be written.
+bool stats_export(const char *path);
+
+#endif
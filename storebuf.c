@@ -0,0 +1,92 @@
+/*
+ * Filename: storebuf.c
+ * Store buffer entries, see storebuf.h.
+ */
+#include "storebuf.h"
+
+#include <string.h>
+
+int store_buffer_size;
+enum consistency consistency = CONS_TSO;
+
+const char *const consistency_names[CONSISTENCIES] = {[CONS_SC] = "sc",
+                                                      [CONS_TSO] = "tso"};
+
+void store_buffer_init(struct store_buffer *sb, struct arena *a, int size,
+                       int line_size) {
+  sb->head = sb->len = 0;
+  sb->size = size;
+  sb->line_size = line_size;
+  sb->busy_until = 0;
+  sb->entries =
+      (struct store_entry *)arena_alloc(a, sizeof(struct store_entry) * size);
+  byte *data = (byte *)arena_alloc(a, (size_t)size * line_size);
+  uint8_t *written = (uint8_t *)arena_alloc(a, (size_t)size * line_size);
+  if (arena_sizing(a))
+    return;
+  for (int i = 0; i < size; i++) {
+    sb->entries[i].data = data + (size_t)i * line_size;
+    sb->entries[i].written = written + (size_t)i * line_size;
+  }
+}
+
+bool sb_push(struct store_buffer *sb, uint64_t line, int offset,
+             const byte *src, int len, uint64_t now) {
+  struct store_entry *e =
+      &sb->entries[(sb->head + sb->len - 1 + sb->size) % sb->size];
+  bool coalesce = sb->len && e->line == line;
+  if (!coalesce) {
+    e = &sb->entries[(sb->head + sb->len) % sb->size];
+    sb->len++;
+    e->line = line;
+    e->ready = now;
+    e->stores = 0;
+  }
+  memcpy(e->data + offset, src, len);
+  memset(e->written + offset, 1, len);
+  e->stores++;
+  return coalesce;
+}
+
+bool sb_forward(const struct store_buffer *sb, uint64_t line, int offset,
+                byte *value) {
+  for (int i = sb->len - 1; i >= 0; i--) {
+    const struct store_entry *e = &sb->entries[(sb->head + i) % sb->size];
+    if (e->line == line && e->written[offset]) {
+      *value = e->data[offset];
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t earlier(uint64_t t, uint64_t cycles) {
+  return t > cycles ? t - cycles : 0;
+}
+
+void sb_rebase(struct store_buffer *sb, uint64_t cycles) {
+  sb->busy_until = earlier(sb->busy_until, cycles);
+  for (int i = 0; i < sb->len; i++) {
+    struct store_entry *e = &sb->entries[(sb->head + i) % sb->size];
+    e->ready = earlier(e->ready, cycles);
+  }
+}
+
+void sb_checkpoint(struct checkpoint *ck, struct store_buffer *sb) {
+  uint64_t head = sb->head, len = sb->len;
+  ckpt_u64(ck, &head);
+  ckpt_u64(ck, &len);
+  ckpt_u64(ck, &sb->busy_until);
+  sb->head = head;
+  sb->len = len;
+  for (int i = 0; i < sb->size; i++) {
+    struct store_entry *e = &sb->entries[i];
+    uint64_t stores = e->stores;
+    ckpt_u64(ck, &e->line);
+    ckpt_u64(ck, &e->ready);
+    ckpt_u64(ck, &stores);
+    e->stores = stores;
+    ckpt_bytes(ck, e->data, sb->line_size);
+    ckpt_bytes(ck, e->written, sb->line_size);
+  }
+}
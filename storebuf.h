@@ -0,0 +1,87 @@
+/*
+ * Filename: storebuf.h
+ * Per-core store buffers and the memory consistency model.
+ *
+ * With a store buffer a write only costs the core an L1 access: the store
+ * waits in the core's buffer and is performed on the caches later, one
+ * buffered store after the other in program order, each starting once the
+ * previous one has finished. Consecutive stores to the same line coalesce
+ * into one entry, which reaches the caches as a single access. A core only
+ * waits for its buffer when it is full, and under SC when it reads: SC keeps
+ * every read behind the stores before it, while TSO lets reads bypass them
+ * and forwards the youngest buffered value of the address read.
+ *
+ * Coalescing only ever merges into the youngest entry, so stores still
+ * leave the buffer in program order, as TSO requires. A store straddling
+ * lines takes an entry per line. Fences and atomics wait until the buffer
+ * has drained, and so does a read that finds only some of its bytes
+ * buffered.
+ */
+#ifndef STOREBUF_H
+#define STOREBUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "checkpoint.h"
+#include "trace.h"
+
+enum consistency { CONS_SC, CONS_TSO, CONSISTENCIES };
+
+extern const char *const consistency_names[CONSISTENCIES];
+
+// Entries per store buffer, 0 for none, and the model they follow.
+extern int store_buffer_size;
+extern enum consistency consistency;
+
+// The stores to one line, as line_size bytes and which of them are written.
+struct store_entry {
+  uint64_t line;   // address of the first byte of the line
+  uint64_t ready;  // core cycle the first store was buffered at
+  uint32_t stores; // stores coalesced into the entry
+  byte *data;
+  uint8_t *written;
+};
+
+struct store_buffer {
+  int head, len, size;
+  int line_size;
+  uint64_t busy_until; // cycle the store being performed finishes at
+  struct store_entry *entries;
+};
+
+// Carve an empty buffer of size entries from a.
+void store_buffer_init(struct store_buffer *sb, struct arena *a, int size,
+                       int line_size);
+
+static inline struct store_entry *sb_head(struct store_buffer *sb) {
+  return &sb->entries[sb->head];
+}
+
+static inline void sb_pop(struct store_buffer *sb) {
+  struct store_entry *e = sb_head(sb);
+  for (int i = 0; i < sb->line_size; i++)
+    e->written[i] = 0;
+  sb->head = (sb->head + 1) % sb->size;
+  sb->len--;
+}
+
+// Buffer a store of the len bytes at src to offset of line, made at cycle
+// now. Returns true if it coalesced into the youngest entry. The buffer must
+// not be full unless the youngest entry is for line.
+bool sb_push(struct store_buffer *sb, uint64_t line, int offset,
+             const byte *src, int len, uint64_t now);
+
+// Whether a store to offset of line is buffered, and if so the youngest
+// value stored there.
+bool sb_forward(const struct store_buffer *sb, uint64_t line, int offset,
+                byte *value);
+
+// Move the times of sb back by cycles, those earlier than that to 0.
+void sb_rebase(struct store_buffer *sb, uint64_t cycles);
+
+// Save or restore the buffered stores.
+void sb_checkpoint(struct checkpoint *ck, struct store_buffer *sb);
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * Filename: sweep.c
+ * Runs the same traces against many cache configurations in one pass.
+ *
+ * The traces are decoded once into memory, and every configuration of the
+ * sweep then runs from there as an independent cache model, in parallel
+ * across host threads. A model gives each core a private cache (the
+ * tag_cache of hierarchy.h) and runs the cores round robin, one instruction
+ * each, like cache_sim -q 1. A write invalidates the line in every other
+ * core, so misses include the coherence misses of a write-invalidate
+ * protocol. Atomics count as writes, fences are dropped as the traces are
+ * loaded, and every access is looked up at the line of its first byte.
+ *
+ * With a single trace, every LRU configuration sharing a set count and line
+ * size is answered by one pass computing LRU stack distances per set: an
+ * access hits in a cache of w ways exactly if fewer than w other lines of
+ * its set were touched since the line's last access, so the histogram of
+ * those distances gives the misses of every associativity at once.
+ *
+ * usage: cache_sweep [-S sets,...] [-A ways,...] [-B bytes,...]
+ *                    [-r policy,...] [-j threads] [-s] trace_0 [trace_1 ...]
+ *
+ * Every combination of the listed values is one configuration. -s simulates
+ * LRU configurations too instead of using stack distances.
+ */
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "hierarchy.h"
+#include "replacement.h"
+#include "trace.h"
+
+// Values per list option.
+#define MAX_VALUES 64
+
+struct config {
+  int sets, ways, line_size;
+  enum repl_policy policy;
+};
+
+struct result {
+  uint64_t accesses, misses, invalidations;
+  bool stack; // computed from stack distances
+};
+
+// The traces, decoded once: insts[core][0..lens[core]).
+static int num_cores;
+static decoded **insts;
+static size_t *lens;
+
+static bool load_trace(const char *path, int core) {
+  trace *t = trace_open(path, true);
+  if (!t)
+    return false;
+  size_t cap = 1 << 16, len = 0, n;
+  decoded *buf = (decoded *)malloc(sizeof(decoded) * cap);
+  while ((n = trace_read(t, buf + len, cap - len)) > 0) {
+    size_t end = len + n;
+    for (size_t i = len; i < end; i++) {
+      if (buf[i].type != INST_FENCE)
+        buf[len++] = buf[i];
+    }
+    if (len == cap) {
+      cap *= 2;
+      buf = (decoded *)realloc(buf, sizeof(decoded) * cap);
+    }
+  }
+  trace_close(t);
+  insts[core] = buf;
+  lens[core] = len;
+  return true;
+}
+
+// Parse a comma separated list of positive numbers into values. Returns how
+// many, 0 if the list is invalid.
+static int parse_list(char *arg, int *values) {
+  int n = 0;
+  for (char *v = strtok(arg, ","); v; v = strtok(NULL, ",")) {
+    if (n == MAX_VALUES || (values[n] = atoi(v)) <= 0)
+      return 0;
+    n++;
+  }
+  return n;
+}
+
+static int parse_policies(char *arg, enum repl_policy *values) {
+  int n = 0;
+  for (char *v = strtok(arg, ","); v; v = strtok(NULL, ",")) {
+    int policy = repl_parse(v);
+    if (n == MAX_VALUES || policy < 0)
+      return 0;
+    values[n++] = policy;
+  }
+  return n;
+}
+
+// Run every core through its own cache of configuration cfg.
+static void simulate(const struct config *cfg, struct result *r) {
+  struct arena a = {0};
+  struct tag_cache *l1 =
+      (struct tag_cache *)malloc(sizeof(struct tag_cache) * num_cores);
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass)
+      arena_map(&a);
+    for (int core = 0; core < num_cores; core++)
+      tag_cache_init(&l1[core], &a, cfg->sets, cfg->ways, cfg->policy,
+                     core + 1);
+  }
+
+  size_t *pos = (size_t *)calloc(num_cores, sizeof(size_t));
+  for (bool live = true; live;) {
+    live = false;
+    for (int core = 0; core < num_cores; core++) {
+      if (pos[core] == lens[core])
+        continue;
+      live = true;
+      decoded inst = insts[core][pos[core]++];
+      uint64_t line = inst.address / cfg->line_size;
+      int set = line % cfg->sets;
+      r->accesses++;
+      if (!tag_cache_lookup(&l1[core], set, line, cfg->policy, true)) {
+        uint64_t victim;
+        r->misses++;
+        tag_cache_insert(&l1[core], set, line, cfg->policy, &victim);
+      }
+      if (inst.type != INST_READ) {
+        for (int other = 0; other < num_cores; other++) {
+          if (other != core && tag_cache_remove(&l1[other], set, line))
+            r->invalidations++;
+        }
+      }
+    }
+  }
+  free(pos);
+  free(l1);
+  arena_unmap(&a);
+}
+
+// Answer the LRU configurations group[0..n) of the single trace, which
+// share their set count and line size, from one pass of stack distances.
+static void stack_distances(const struct config *configs,
+                            struct result *results, const int *group,
+                            int n) {
+  const struct config *first = &configs[group[0]];
+  int sets = first->sets, line_size = first->line_size, depth = 0;
+  for (int i = 0; i < n; i++) {
+    if (configs[group[i]].ways > depth)
+      depth = configs[group[i]].ways;
+  }
+
+  // The lines of each set, most recently used first, up to depth of them.
+  uint64_t *stack = (uint64_t *)malloc(sizeof(uint64_t) * sets * depth);
+  int *filled = (int *)calloc(sets, sizeof(int));
+  // hist[d] counts accesses with d other lines used since, deep the rest.
+  uint64_t *hist = (uint64_t *)calloc(depth, sizeof(uint64_t));
+  uint64_t deep = 0;
+  for (size_t i = 0; i < lens[0]; i++) {
+    uint64_t line = insts[0][i].address / line_size;
+    int set = line % sets;
+    uint64_t *s = stack + (size_t)set * depth;
+    int d = 0;
+    while (d < filled[set] && s[d] != line)
+      d++;
+    if (d < filled[set]) {
+      hist[d]++;
+    } else {
+      deep++;
+      if (filled[set] < depth)
+        filled[set]++;
+      d = filled[set] - 1;
+    }
+    memmove(s + 1, s, sizeof(uint64_t) * d);
+    s[0] = line;
+  }
+
+  for (int i = 0; i < n; i++) {
+    struct result *r = &results[group[i]];
+    r->accesses = lens[0];
+    r->misses = deep;
+    for (int d = configs[group[i]].ways; d < depth; d++)
+      r->misses += hist[d];
+    r->stack = true;
+  }
+  free(stack);
+  free(filled);
+  free(hist);
+}
+
+static int usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-S sets,...] [-A ways,...] [-B bytes,...] "
+          "[-r policy,...] [-j threads] [-s] trace_0 [trace_1 ...]\n",
+          prog);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  int sets[MAX_VALUES] = {16, 64, 256, 1024}, num_sets = 4;
+  int ways[MAX_VALUES] = {1, 2, 4, 8}, num_ways = 4;
+  int lines[MAX_VALUES] = {64}, num_lines = 1;
+  enum repl_policy policies[MAX_VALUES] = {REPL_LRU};
+  int num_policies = 1, threads = 0;
+  bool use_stack = true;
+  int opt;
+  while ((opt = getopt(argc, argv, "S:A:B:r:j:s")) != -1) {
+    switch (opt) {
+    case 'S':
+      num_sets = parse_list(optarg, sets);
+      break;
+    case 'A':
+      num_ways = parse_list(optarg, ways);
+      break;
+    case 'B':
+      num_lines = parse_list(optarg, lines);
+      break;
+    case 'r':
+      num_policies = parse_policies(optarg, policies);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 's':
+      use_stack = false;
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind == argc || !num_sets || !num_ways || !num_lines ||
+      !num_policies || threads < 0)
+    return usage(argv[0]);
+
+  num_cores = argc - optind;
+  insts = (decoded **)malloc(sizeof(decoded *) * num_cores);
+  lens = (size_t *)malloc(sizeof(size_t) * num_cores);
+  for (int core = 0; core < num_cores; core++) {
+    if (!load_trace(argv[optind + core], core))
+      return 1;
+  }
+
+  int max_configs = num_sets * num_ways * num_lines * num_policies;
+  struct config *configs =
+      (struct config *)malloc(sizeof(struct config) * max_configs);
+  int num_configs = 0;
+  for (int p = 0; p < num_policies; p++) {
+    for (int b = 0; b < num_lines; b++) {
+      for (int s = 0; s < num_sets; s++) {
+        for (int w = 0; w < num_ways; w++) {
+          const char *bad = repl_check(policies[p], ways[w]);
+          if (bad) {
+            fprintf(stderr, "skipping %d ways of %s: %s\n", ways[w],
+                    repl_names[policies[p]], bad);
+            continue;
+          }
+          configs[num_configs++] =
+              (struct config){sets[s], ways[w], lines[b], policies[p]};
+        }
+      }
+    }
+  }
+
+  // Jobs of one simulated configuration, or a group of LRU configurations
+  // answered from the same stack distances.
+  int *members = (int *)malloc(sizeof(int) * num_configs);
+  int *job_start = (int *)malloc(sizeof(int) * (num_configs + 1));
+  bool *job_stack = (bool *)malloc(sizeof(bool) * num_configs);
+  bool *assigned = (bool *)calloc(num_configs, sizeof(bool));
+  int num_jobs = 0, num_members = 0;
+  for (int i = 0; i < num_configs; i++) {
+    if (assigned[i])
+      continue;
+    bool stack = use_stack && num_cores == 1 && configs[i].policy == REPL_LRU;
+    job_start[num_jobs] = num_members;
+    job_stack[num_jobs++] = stack;
+    for (int j = i; j < num_configs; j++) {
+      if (j == i ||
+          (stack && !assigned[j] && configs[j].policy == REPL_LRU &&
+           configs[j].sets == configs[i].sets &&
+           configs[j].line_size == configs[i].line_size)) {
+        assigned[j] = true;
+        members[num_members++] = j;
+      }
+    }
+  }
+  job_start[num_jobs] = num_members;
+
+  struct result *results =
+      (struct result *)calloc(num_configs, sizeof(struct result));
+  if (threads)
+    omp_set_num_threads(threads);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int j = 0; j < num_jobs; j++) {
+    const int *group = members + job_start[j];
+    if (job_stack[j])
+      stack_distances(configs, results, group,
+                      job_start[j + 1] - job_start[j]);
+    else
+      simulate(&configs[group[0]], &results[group[0]]);
+  }
+
+  printf("%8s %6s %6s %-7s %10s %14s %14s %9s %14s %s\n", "sets", "ways",
+         "line", "policy", "bytes", "accesses", "misses", "miss_rate",
+         "invalidations", "method");
+  for (int i = 0; i < num_configs; i++) {
+    const struct config *c = &configs[i];
+    const struct result *r = &results[i];
+    printf("%8d %6d %6d %-7s %10llu %14llu %14llu %8.4f%% %14llu %s\n",
+           c->sets, c->ways, c->line_size, repl_names[c->policy],
+           (unsigned long long)c->sets * c->ways * c->line_size,
+           (unsigned long long)r->accesses, (unsigned long long)r->misses,
+           r->accesses ? 100.0 * r->misses / r->accesses : 0.0,
+           (unsigned long long)r->invalidations,
+           r->stack ? "stack" : "sim");
+  }
+
+  for (int core = 0; core < num_cores; core++)
+    free(insts[core]);
+  free(insts);
+  free(lens);
+  free(configs);
+  free(members);
+  free(job_start);
+  free(job_stack);
+  free(assigned);
+  free(results);
+  return 0;
+}
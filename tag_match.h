@@ -0,0 +1,108 @@
+/*
+ * Filename: tag_match.h
+ * Tag lookup for caches stored as structure of arrays.
+ *
+ * A set is `ways` consecutive 64-bit tags plus `ways` consecutive state
+ * bytes, where 0 means Invalid. tag_find() returns the way holding a tag in a
+ * valid state, or -1. Built with AVX2 it compares four tags per instruction
+ * (two with SSE4.1) and derives the valid ways of up to 16 lines from a
+ * single compare of their state bytes; otherwise it falls back to the scalar
+ * loop. The vector kernels read state bytes in blocks of 16, so state arrays
+ * must be allocated with TAG_MATCH_PAD bytes of slack after the last line.
+ *
+ * All kernels are meant to be inlined with a constant `ways`.
+ */
+#ifndef TAG_MATCH_H
+#define TAG_MATCH_H
+
+#include <stdint.h>
+
+#if defined(__SSE4_1__)
+#  include <immintrin.h>
+#endif
+
+#define TAG_MATCH_PAD 16
+
+static inline __attribute__((always_inline)) int
+tag_find_scalar(const uint64_t *tags, const uint8_t *states, uint64_t tag,
+                const int ways) {
+#pragma GCC unroll 16
+  for (int w = 0; w < ways; w++) {
+    if (states[w] && tags[w] == tag)
+      return w;
+  }
+  return -1;
+}
+
+#if defined(__SSE4_1__)
+// Bit w set if line w of the 16 starting at states is valid.
+static inline __attribute__((always_inline)) unsigned
+valid_mask16(const uint8_t *states) {
+  __m128i s = _mm_loadu_si128((const __m128i *)states);
+  return ~_mm_movemask_epi8(_mm_cmpeq_epi8(s, _mm_setzero_si128())) & 0xffff;
+}
+#endif
+
+static inline __attribute__((always_inline)) int
+tag_find(const uint64_t *tags, const uint8_t *states, uint64_t tag,
+         const int ways) {
+#if defined(__SSE4_1__)
+  unsigned valid = 0;
+  int w = 0;
+#  if defined(__AVX2__)
+  __m256i key4 = _mm256_set1_epi64x((long long)tag);
+#    pragma GCC unroll 4
+  for (; w + 4 <= ways; w += 4) {
+    if (w % 16 == 0)
+      valid = valid_mask16(states + w);
+    __m256i eq = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256((const __m256i *)(tags + w)), key4);
+    unsigned m = _mm256_movemask_pd(_mm256_castsi256_pd(eq)) &
+                 (valid >> (w % 16));
+    if (m & 0xf)
+      return w + __builtin_ctz(m);
+  }
+#  endif
+  __m128i key2 = _mm_set1_epi64x((long long)tag);
+#  pragma GCC unroll 8
+  for (; w + 2 <= ways; w += 2) {
+    if (w % 16 == 0)
+      valid = valid_mask16(states + w);
+    __m128i eq =
+        _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(tags + w)), key2);
+    unsigned m = _mm_movemask_pd(_mm_castsi128_pd(eq)) & (valid >> (w % 16));
+    if (m & 0x3)
+      return w + __builtin_ctz(m);
+  }
+  if (w < ways && states[w] && tags[w] == tag)
+    return w;
+  return -1;
+#else
+  return tag_find_scalar(tags, states, tag, ways);
+#endif
+}
+
+// First invalid way of a set, or -1 if every line is valid.
+static inline __attribute__((always_inline)) int
+find_invalid(const uint8_t *states, const int ways) {
+#if defined(__SSE4_1__)
+#  pragma GCC unroll 4
+  for (int w = 0; w < ways; w += 16) {
+    unsigned empty = ~valid_mask16(states + w) & 0xffff;
+    if (ways - w < 16)
+      empty &= (1u << (ways - w)) - 1;
+    if (empty)
+      return w + __builtin_ctz(empty);
+  }
+  return -1;
+#else
+#  pragma GCC unroll 16
+  for (int w = 0; w < ways; w++) {
+    if (!states[w])
+      return w;
+  }
+  return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Filename: test_traces.sh
+# Checks that compressed traces decode to the same records as the binary
+# trace they were made from. The trace is well over one decompressed chunk
+# (see decompress.h), so records straddle chunk boundaries. Needs the zstd
+# and lz4 tools and the codecs: run it as ZSTD=1 LZ4=1 ./test_traces.sh.
+#
+# usage: ./test_traces.sh [records]
+set -e
+
+records=${1:-300000}
+
+make -s gen_trace trace_conv trace_cmp >/dev/null
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+./gen_trace -p uniform -c 1 -n "$records" -w 0.3 -t "$dir/t" >/dev/null
+./trace_conv "$dir/t_0.txt" "$dir/t.trc" >/dev/null
+./trace_cmp "$dir/t_0.txt" "$dir/t.trc"
+zstd -q "$dir/t.trc" -o "$dir/t.trc.zst"
+./trace_cmp "$dir/t.trc" "$dir/t.trc.zst"
+lz4 -q "$dir/t.trc" "$dir/t.trc.lz4"
+./trace_cmp "$dir/t.trc" "$dir/t.trc.lz4"
@@ -0,0 +1,486 @@
+/*
+ * Filename: trace.c
+ * Text and binary trace readers, see trace.h.
+ */
+#include "trace.h"
+
+#include "decompress.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+static int hex_digit(char ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+// Parse a decimal integer with an optional sign, or a hex one with a 0x
+// prefix. Returns NULL if there are no digits at p.
+static const char *parse_int(const char *p, const char *end, int64_t *v) {
+  bool neg = p < end && *p == '-';
+  if (neg || (p < end && *p == '+'))
+    p++;
+  uint64_t n = 0;
+  const char *digits;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    p += 2;
+    digits = p;
+    for (int d; p < end && (d = hex_digit(*p)) >= 0; p++)
+      n = n << 4 | (uint64_t)d;
+  } else {
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+      n = n * 10 + (uint64_t)(*p++ - '0');
+  }
+  if (p == digits)
+    return NULL;
+  *v = neg ? -(int64_t)n : (int64_t)n;
+  return p;
+}
+
+// Mnemonics of the text format and the values each takes after the address.
+static const struct {
+  const char *name;
+  int len, values;
+} mnemonics[INST_PREFETCH] = {
+    [INST_READ] = {"RD", 2, 0},  [INST_WRITE] = {"WR", 2, 1},
+    [INST_CAS] = {"CAS", 3, 2},  [INST_FAA] = {"FAA", 3, 1},
+    [INST_FENCE] = {"FENCE", 5, 0},
+};
+
+// Parse the text trace line [p, end) at full width into a binary record.
+// Returns false if the line is not an instruction. The line does not need to
+// be NUL terminated, so this works directly on a mapped file.
+static bool parse_inst_line(const char *p, const char *end,
+                            struct trace_record *r) {
+  p = skip_blanks(p, end);
+  int type = 0;
+  while (type < INST_PREFETCH &&
+         (end - p < mnemonics[type].len ||
+          memcmp(p, mnemonics[type].name, mnemonics[type].len)))
+    type++;
+  if (type == INST_PREFETCH)
+    return false;
+  p += mnemonics[type].len;
+  memset(r, 0, sizeof(*r));
+  r->type = type;
+  r->size = 1;
+  if (type == INST_FENCE)
+    return true;
+  if (p < end && (*p == '1' || *p == '2' || *p == '4' || *p == '8'))
+    r->size = *p++ - '0';
+
+  int64_t addr, vals[2] = {-1, 0};
+  p = parse_int(skip_blanks(p, end), end, &addr);
+  if (!p)
+    return false;
+  for (int i = 0; i < mnemonics[type].values; i++) {
+    p = parse_int(skip_blanks(p, end), end, &vals[i]);
+    if (!p)
+      return false;
+  }
+  r->address = (uint64_t)addr;
+  r->value = (uint64_t)vals[0];
+  r->operand = (uint64_t)vals[1];
+  return true;
+}
+
+static void decode_record(const struct trace_record *r, decoded *inst) {
+  inst->address = r->address;
+  inst->value = r->value;
+  inst->operand = r->operand;
+  inst->type = r->type;
+  inst->size = r->size;
+}
+
+// Whether a binary record holds an instruction traces can carry.
+static bool record_valid(const struct trace_record *r) {
+  return r->type < INST_PREFETCH &&
+         (r->size == 1 || r->size == 2 || r->size == 4 || r->size == 8);
+}
+
+// Decode the record at p of a trace of the given version. Returns false,
+// leaving inst undefined, if the record is invalid.
+static bool decode_binary(const char *p, int version, decoded *inst) {
+  if (version == TRACE_VERSION) {
+    const struct trace_record *r = (const struct trace_record *)p;
+    decode_record(r, inst);
+    return record_valid(r);
+  }
+  const struct trace_record_v1 *r = (const struct trace_record_v1 *)p;
+  *inst = (decoded){.address = r->address,
+                    .value = (uint64_t)(int64_t)r->value,
+                    .type = r->type,
+                    .size = 1};
+  return r->type <= INST_WRITE;
+}
+
+// Count an invalid record of t, warning about the first one.
+static void skip_invalid(trace *t) {
+  if (!t->invalid++)
+    fprintf(stderr, "%s: skipping invalid binary records\n", t->filename);
+}
+
+// Decode instruction lines
+decoded decode_inst_line(char *buffer) {
+  decoded inst = {.type = INST_TYPES};
+  struct trace_record r;
+  if (parse_inst_line(buffer, buffer + strlen(buffer), &r))
+    decode_record(&r, &inst);
+  return inst;
+}
+
+// Check a binary header. Returns 1 for a usable binary trace, 0 if this is
+// not a binary trace at all and -1 for a binary trace we can't read. Sets
+// the version and record size of t for a usable one.
+static int check_header(trace *t, const char *filename,
+                        const struct trace_header *header) {
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)))
+    return 0;
+  if (!(header->version == TRACE_VERSION &&
+        header->record_size == sizeof(struct trace_record)) &&
+      !(header->version == 1 &&
+        header->record_size == sizeof(struct trace_record_v1))) {
+    fprintf(stderr, "%s: unsupported binary trace version %d\n", filename,
+            header->version);
+    return -1;
+  }
+  t->version = header->version;
+  t->record_size = header->record_size;
+  return 1;
+}
+
+// Map a regular file read-only. Returns false if the file should be read
+// with stdio instead.
+static bool trace_map(trace *t, const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  t->map = map;
+  t->map_len = st.st_size;
+  return true;
+}
+
+// Hand out the binary records in the len bytes of a decompressed chunk at
+// data, up to the record count of the header. The header in front of the
+// first chunk shifts the records against the chunks, so the last record of
+// a chunk may run on into the next one.
+static bool stream_records(trace *t, const char *data, size_t len) {
+  uint64_t avail = len / t->record_size;
+  uint64_t count = t->remaining < avail ? t->remaining : avail;
+  t->remaining -= count;
+  t->partial = len - avail * t->record_size;
+  t->next = data;
+  t->end = data + count * t->record_size;
+  return count > 0;
+}
+
+// Move a text trace on to the next decompressed chunk, keeping the line that
+// runs off the end of the current one.
+static bool stream_text(trace *t) {
+  size_t keep = t->text_end - t->text;
+  // Lines that long are no instructions; drop their start.
+  if (keep > DECOMP_KEEP)
+    keep = 0;
+  size_t len = decompressor_next(t->stream, &t->text, keep);
+  t->text_end = t->text + len;
+  t->stream_end = len == keep;
+  return len > 0;
+}
+
+// Open the compressed trace of t->file, its first probed bytes already read
+// into header.
+static trace *stream_open(trace *t, const char *filename,
+                          enum compression comp,
+                          const struct trace_header *header, size_t probed) {
+  t->stream = decompressor_open(t->file, comp, filename, header, probed);
+  t->file = NULL;
+  if (!t->stream) {
+    free(t->filename);
+    free(t);
+    return NULL;
+  }
+
+  const char *data;
+  size_t len = decompressor_next(t->stream, &data, 0);
+  t->stream_end = !len;
+  struct trace_header inner;
+  int binary = 0;
+  if (len >= sizeof(inner)) {
+    memcpy(&inner, data, sizeof(inner));
+    binary = check_header(t, filename, &inner);
+  }
+  if (binary < 0) {
+    trace_close(t);
+    return NULL;
+  }
+  t->binary = binary;
+  if (t->binary) {
+    // Records start after the header.
+    t->remaining = inner.count;
+    stream_records(t, data + sizeof(inner), len - sizeof(inner));
+  } else {
+    t->text = data;
+    t->text_end = data + len;
+  }
+  return t;
+}
+
+trace *trace_open(const char *filename, bool use_mmap) {
+  trace *t = (trace *)calloc(1, sizeof(trace));
+  t->filename = strdup(filename);
+  struct trace_header header;
+
+  if (use_mmap && trace_map(t, filename) &&
+      compression_detect(t->map, t->map_len) != COMP_NONE) {
+    // Compressed traces go through the decompressor instead.
+    munmap((void *)t->map, t->map_len);
+    t->map = NULL;
+  }
+
+  if (t->map) {
+    int binary = 0;
+    if (t->map_len >= sizeof(header)) {
+      memcpy(&header, t->map, sizeof(header));
+      binary = check_header(t, filename, &header);
+    }
+    if (binary < 0) {
+      trace_close(t);
+      return NULL;
+    }
+    t->binary = binary;
+    if (t->binary) {
+      // Records start right after the 16-byte header, so they stay aligned
+      // within the page-aligned mapping.
+      uint64_t avail = (t->map_len - sizeof(header)) / t->record_size;
+      t->next = t->map + sizeof(header);
+      t->end = t->next +
+               (header.count < avail ? header.count : avail) * t->record_size;
+    } else {
+      t->text = t->map;
+      t->text_end = t->map + t->map_len;
+    }
+    return t;
+  }
+
+  t->file = fopen(filename, "rb");
+  if (!t->file) {
+    perror(filename);
+    free(t->filename);
+    free(t);
+    return NULL;
+  }
+  size_t probed = fread(&header, 1, sizeof(header), t->file);
+  enum compression comp = compression_detect(&header, probed);
+  if (comp != COMP_NONE)
+    return stream_open(t, filename, comp, &header, probed);
+  if (probed == sizeof(header)) {
+    int binary = check_header(t, filename, &header);
+    if (binary < 0) {
+      trace_close(t);
+      return NULL;
+    }
+    t->binary = binary;
+  }
+  if (t->binary) {
+    t->remaining = header.count;
+    t->buf = (char *)malloc(t->record_size * TRACE_CHUNK);
+  } else if (fseek(t->file, 0, SEEK_SET)) {
+    memcpy(t->pending, &header, probed);
+    t->pending_len = probed;
+  }
+  return t;
+}
+
+// Refill the record buffer of a binary trace read through stdio.
+static bool trace_fill(trace *t) {
+  if (t->stream) {
+    if (!t->remaining)
+      return false;
+    // The start of a record split by the chunk end comes back in front.
+    const char *data;
+    size_t len = decompressor_next(t->stream, &data, t->partial);
+    return stream_records(t, data, len);
+  }
+  size_t want = t->remaining < TRACE_CHUNK ? t->remaining : TRACE_CHUNK;
+  if (!t->file || !want)
+    return false;
+  size_t len = fread(t->buf, t->record_size, want, t->file);
+  t->remaining = len == want ? t->remaining - want : 0;
+  t->next = t->buf;
+  t->end = t->buf + len * t->record_size;
+  return len > 0;
+}
+
+// fgets for a text trace read through stdio, starting with any bytes left
+// over from header probing.
+static bool read_line(trace *t, char *line, size_t size) {
+  size_t n = 0;
+  while (t->pending_pos < t->pending_len && n + 1 < size) {
+    char ch = t->pending[t->pending_pos++];
+    line[n++] = ch;
+    if (ch == '\n')
+      break;
+  }
+  line[n] = '\0';
+  if (n && (line[n - 1] == '\n' || n + 1 == size))
+    return true;
+  return fgets(line + n, size - n, t->file) || n;
+}
+
+bool trace_next(trace *t, decoded *inst) {
+  if (t->binary) {
+    for (;;) {
+      if (t->next == t->end && !trace_fill(t))
+        return false;
+      bool valid = decode_binary(t->next, t->version, inst);
+      t->next += t->record_size;
+      if (valid)
+        return true;
+      skip_invalid(t);
+    }
+  }
+
+  if (t->map || t->stream) {
+    for (;;) {
+      const char *end = t->text_end;
+      while (t->text < end) {
+        const char *line = t->text;
+        const char *nl = memchr(line, '\n', end - line);
+        // A line running off a chunk continues in the next one.
+        if (!nl && t->stream && !t->stream_end)
+          break;
+        t->text = nl ? nl + 1 : end;
+        struct trace_record r;
+        if (parse_inst_line(line, nl ? nl : end, &r)) {
+          decode_record(&r, inst);
+          return true;
+        }
+      }
+      if (!t->stream || t->stream_end || !stream_text(t))
+        return false;
+    }
+  }
+
+  char inst_line[96];
+  while (read_line(t, inst_line, sizeof(inst_line))) {
+    *inst = decode_inst_line(inst_line);
+    if (inst->type != INST_TYPES)
+      return true;
+  }
+  return false;
+}
+
+size_t trace_read(trace *t, decoded *insts, size_t max) {
+  size_t n = 0;
+  if (!t->binary) {
+    while (n < max && trace_next(t, &insts[n]))
+      n++;
+    return n;
+  }
+  // Binary records convert in runs that never check for the end of a chunk.
+  while (n < max && (t->next < t->end || trace_fill(t))) {
+    size_t avail = (t->end - t->next) / t->record_size;
+    size_t run = avail < max - n ? avail : max - n;
+    size_t valid = 0;
+    if (t->version == TRACE_VERSION) {
+      const struct trace_record *r = (const struct trace_record *)t->next;
+      for (size_t i = 0; i < run; i++) {
+        decode_record(&r[i], &insts[n + valid]);
+        valid += record_valid(&r[i]);
+      }
+    } else {
+      for (size_t i = 0; i < run; i++)
+        valid += decode_binary(t->next + i * t->record_size, t->version,
+                               &insts[n + valid]);
+    }
+    for (size_t i = valid; i < run; i++)
+      skip_invalid(t);
+    t->next += run * t->record_size;
+    n += valid;
+  }
+  return n;
+}
+
+uint64_t trace_skip(trace *t, uint64_t n) {
+  uint64_t skipped = 0;
+  if (t->binary) {
+    // Records in memory are skipped without decoding them, but invalid ones
+    // don't count, as trace_next() never returns them.
+    while (skipped < n && (t->next < t->end || trace_fill(t))) {
+      decoded inst;
+      if (decode_binary(t->next, t->version, &inst))
+        skipped++;
+      else
+        skip_invalid(t);
+      t->next += t->record_size;
+    }
+    return skipped;
+  }
+  decoded inst;
+  while (skipped < n && trace_next(t, &inst))
+    skipped++;
+  return skipped;
+}
+
+void trace_close(trace *t) {
+  if (t->map)
+    munmap((void *)t->map, t->map_len);
+  if (t->file)
+    fclose(t->file);
+  if (t->stream)
+    decompressor_close(t->stream);
+  free(t->buf);
+  free(t->filename);
+  free(t);
+}
+
+long trace_convert(FILE *in, FILE *out) {
+  struct trace_header header = {.version = TRACE_VERSION,
+                                .record_size = sizeof(struct trace_record)};
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+
+  // The record count is patched in once the whole input has been read.
+  if (fwrite(&header, sizeof(header), 1, out) != 1)
+    return -1;
+
+  char inst_line[96];
+  while (fgets(inst_line, sizeof(inst_line), in)) {
+    struct trace_record r;
+    if (!parse_inst_line(inst_line, inst_line + strlen(inst_line), &r))
+      continue;
+    if (fwrite(&r, sizeof(r), 1, out) != 1)
+      return -1;
+    header.count++;
+  }
+
+  if (fseek(out, 0, SEEK_SET) ||
+      fwrite(&header, sizeof(header), 1, out) != 1)
+    return -1;
+  return (long)header.count;
+}
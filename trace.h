@@ -0,0 +1,165 @@
+/*
+ * Filename: trace.h
+ * Instruction trace ingestion for the cache simulator.
+ *
+ * Two trace formats are understood:
+ * - text: one instruction per line. This is what the hand-written
+ *   input_N.txt files use. Addresses and values are 64-bit, in decimal or
+ *   with a 0x prefix in hex:
+ *     RD <address>                    load
+ *     WR <address> <val>              store
+ *     CAS <address> <expected> <new>  compare-and-swap
+ *     FAA <address> <add>             fetch-and-add
+ *     FENCE                           full memory fence
+ *   RD, WR, CAS and FAA access 1 byte, or 2, 4 or 8 with the size as a
+ *   suffix (e.g. "RD4 0x40" or "CAS8 64 0 1"). Multi-byte values are little
+ *   endian in memory.
+ * - binary: a trace_header followed by fixed-width trace_records in host
+ *   byte order. Records are copied out of the file as-is, so the hot path
+ *   never goes through sscanf. Use trace_conv to produce one from a text
+ *   trace. Version 1 traces, of 1-byte RD and WR only, are still read.
+ *   Records of an unknown type or size are skipped, like text lines that
+ *   are no instruction, with a warning on stderr.
+ *
+ * trace_open() picks the format by looking for TRACE_MAGIC at the start of
+ * the file. Regular files are normally mapped read-only with mmap and
+ * walked in place, so a core never copies its trace through stdio buffers
+ * and multi-GB traces cost nothing to open. Pipes and other unmappable
+ * files fall back to buffered stdio reads.
+ *
+ * Either format may also be compressed with zstd or LZ4 (e.g. `zstd
+ * input_0.txt`). Compressed traces are recognized by their frame magic and
+ * streamed through a background decompressor, see decompress.h.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef char byte;
+
+struct decompressor;
+
+// Instruction types. Traces hold all but INST_PREFETCH, which only the
+// simulator's prefetchers issue.
+enum inst_type {
+  INST_READ,
+  INST_WRITE,
+  INST_CAS,
+  INST_FAA,
+  INST_FENCE,
+  INST_PREFETCH,
+  INST_TYPES
+};
+
+// Most bytes one instruction accesses.
+#define INST_MAX_SIZE 8
+
+struct decoded_inst {
+  uint64_t address;
+  uint64_t value;   // WR: the value stored, CAS: expected, FAA: the addend
+  uint64_t operand; // CAS: the value stored if the expected one is found
+  uint8_t type;     // enum inst_type
+  uint8_t size;     // bytes accessed, 1, 2, 4 or 8
+};
+typedef struct decoded_inst decoded;
+
+#define TRACE_MAGIC "CSTR"
+#define TRACE_VERSION 2
+
+// Number of binary records pulled from the file per read.
+#define TRACE_CHUNK 4096
+
+struct trace_header {
+  char magic[4];        // TRACE_MAGIC, not NUL terminated
+  uint16_t version;     // TRACE_VERSION
+  uint16_t record_size; // sizeof(struct trace_record)
+  uint64_t count;       // number of records following the header
+};
+
+// Laid out like decoded, so records convert field by field in place.
+struct trace_record {
+  uint64_t address;
+  uint64_t value;
+  uint64_t operand;
+  uint8_t type;
+  uint8_t size;
+  uint8_t pad[6];
+};
+
+// Records of version 1 traces.
+struct trace_record_v1 {
+  uint32_t type; // 0 is RD, 1 is WR
+  int32_t value; // Only used for WR
+  uint64_t address;
+};
+
+struct trace {
+  char *filename;
+  bool binary;
+  uint16_t version;   // of a binary trace
+  size_t record_size; // of a binary trace
+
+  // mmap backend: the whole file, plus a cursor for text traces.
+  const char *map;
+  size_t map_len;
+  const char *text;
+
+  // stdio backend: binary records are read TRACE_CHUNK at a time into buf.
+  FILE *file;
+  uint64_t remaining; // binary records not yet read from the file
+  char *buf;
+  // Bytes consumed while probing for a header on a stream that can't be
+  // rewound; the text reader replays them first.
+  char pending[sizeof(struct trace_header)];
+  size_t pending_pos;
+  size_t pending_len;
+
+  // Compressed backend: decompressed chunks, walked in place like the
+  // mapping. For binary traces remaining counts the records not yet handed
+  // out from a chunk.
+  struct decompressor *stream;
+  bool stream_end; // the current chunk is the last one
+  // Bytes of a binary record the current chunk ends in the middle of.
+  size_t partial;
+
+  // End of the text walked from text.
+  const char *text_end;
+
+  // Binary records left to hand out, record_size bytes each, pointing into
+  // the mapping, a chunk or buf.
+  const char *next;
+  const char *end;
+  uint64_t invalid; // binary records skipped
+};
+typedef struct trace trace;
+
+// Decode a single text trace line. type is INST_TYPES if the line is not an
+// instruction.
+decoded decode_inst_line(char *buffer);
+
+// Open a text or binary trace, mapping it into memory if use_mmap is set and
+// the file allows it. Returns NULL (with a message on stderr) if the file
+// can't be opened or has a bad binary header.
+trace *trace_open(const char *filename, bool use_mmap);
+
+// Fetch the next instruction. Returns false at the end of the trace.
+bool trace_next(trace *t, decoded *inst);
+
+// Decode up to max instructions into insts. Returns how many, fewer than max
+// only at the end of the trace.
+size_t trace_read(trace *t, decoded *insts, size_t max);
+
+// Skip the next n instructions. Returns how many were skipped, fewer than n
+// only at the end of the trace.
+uint64_t trace_skip(trace *t, uint64_t n);
+
+void trace_close(trace *t);
+
+// Convert a text trace to the binary format. Returns the number of records
+// written, or -1 on I/O error.
+long trace_convert(FILE *in, FILE *out);
+
+#endif
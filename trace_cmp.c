@@ -0,0 +1,50 @@
+/*
+ * Filename: trace_cmp.c
+ * Compares two traces record by record, in any of the formats the simulator
+ * reads, e.g. a compressed binary trace against the one it was made from.
+ *
+ * usage: trace_cmp <trace_a> <trace_b>
+ */
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <trace_a> <trace_b>\n", argv[0]);
+    return 1;
+  }
+  trace *a = trace_open(argv[1], true), *b = trace_open(argv[2], true);
+  if (!a || !b)
+    return 1;
+
+  uint64_t n = 0;
+  int status = 0;
+  for (;; n++) {
+    decoded x, y;
+    bool more_a = trace_next(a, &x), more_b = trace_next(b, &y);
+    if (!more_a || !more_b) {
+      if (more_a != more_b) {
+        fprintf(stderr, "%s ends after %" PRIu64 " records\n",
+                more_a ? argv[2] : argv[1], n);
+        status = 1;
+      }
+      break;
+    }
+    if (x.type != y.type || x.size != y.size || x.address != y.address ||
+        x.value != y.value || x.operand != y.operand) {
+      fprintf(stderr,
+              "record %" PRIu64 " differs: type %d size %d address %" PRIu64
+              " vs type %d size %d address %" PRIu64 "\n",
+              n, x.type, x.size, x.address, y.type, y.size, y.address);
+      status = 1;
+      break;
+    }
+  }
+  trace_close(a);
+  trace_close(b);
+  if (!status)
+    printf("%" PRIu64 " records match\n", n);
+  return status;
+}
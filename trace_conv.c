@@ -0,0 +1,38 @@
+/*
+ * Filename: trace_conv.c
+ * Converts a text trace (input_N.txt) into the binary trace format read by
+ * the simulator.
+ *
+ * usage: trace_conv <input.txt> <output.trc>
+ */
+#include "trace.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <input.txt> <output.trc>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *in = fopen(argv[1], "r");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  FILE *out = fopen(argv[2], "wb");
+  if (!out) {
+    perror(argv[2]);
+    fclose(in);
+    return 1;
+  }
+
+  long count = trace_convert(in, out);
+  fclose(in);
+  if (fclose(out) || count < 0) {
+    perror(argv[2]);
+    return 1;
+  }
+  printf("%s: %ld records\n", argv[2], count);
+  return 0;
+}